@@ -10,6 +10,7 @@ enum class ASTKind {
     Let, Assign, Return,
     If, Loop, // loop i from a to b
     Say,
+    Schedule, Every, // schedule c after ms; every ms: ... end
     // expressions
     Binary, Unary, Call, Var, Literal
 };
@@ -23,7 +24,10 @@ struct AST {
     std::string literal;        // string/number text
     std::vector<ASTPtr> kids;   // children
     // for operators / typing
-    std::string op;             // "+", "-", "==", etc.
+    std::string op;             // "+", "-", "==", etc.; a Param's declared type
+    bool parallel = false;      // 'parallel loop ...'
+    std::vector<std::string> qualifiers;  // capsule c from "origin" q1 q2:
+    int line = 0;               // source line of a statement
 
     // utility ctors
     static ASTPtr Node(ASTKind k){ auto n=std::make_shared<AST>(); n->kind=k; return n; }
@@ -0,0 +1,201 @@
+// Benchmark harness: times every compiler and runtime stage on a synthetic
+// program and reports JSON, optionally compared against an earlier run.
+//
+//   cmajor_bench [--funcs=N] [--depth=M] [--iters=K] [--reps=R] [--only=stage,...]
+//                [--out=results.json] [--baseline=old.json] [--threshold=PCT]
+//                [--emit-source=prog.cmaj]
+//
+// Stages: lex, parse, irgen, hex, cil, vm, pipeline (source to finished run),
+// sched-schedule (schedule+cancel, no firing), sched-fire (dispatch and
+// run through the worker pool) and mutlog (MutationLog::record on a warm
+// per-thread ring). With --baseline, a stage whose median is
+// more than PCT percent slower is reported and the exit status is 2.
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "IRGen.hpp"
+#include "EmitHEX.hpp"
+#include "EmitCIL.hpp"
+#include "Runner.cpp"  // VM and scheduler
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <map>
+
+// N functions, each a K-iteration loop over an M-operator expression of its
+// arguments, called once each from main. Same parameters, same program.
+static std::string synthesize(int funcs, int depth, int iters){
+    std::uint32_t seed = 0x9e3779b9u;
+    auto next = [&]{ seed ^= seed<<13; seed ^= seed>>17; seed ^= seed<<5; return seed; };
+    const char* vars[] = { "a", "b", "i", "acc" };
+    std::ostringstream os;
+    for (int f=0;f<funcs;f++){
+        os<<"func f"<<f<<"(a, b):\n    let acc = "<<f<<";\n";
+        os<<"    loop i from 0 to "<<iters<<":\n        acc = ";
+        std::string e = vars[next()%4];
+        unsigned mul = 1;
+        for (int d=0;d<depth;d++){
+            switch (d%4){   // each multiply is undone by a larger divide, so acc stays small
+                case 0: e = "("+e+" + "+vars[next()%4]+")"; break;
+                case 1: mul = next()%7+1; e = "("+e+" * "+std::to_string(mul)+")"; break;
+                case 2: e = "("+e+" - "+vars[next()%4]+")"; break;
+                default: e = "("+e+" / "+std::to_string(mul+1+next()%4)+")"; break;
+            }
+        }
+        os<<e<<";\n    end\n    return acc;\nend\n\n";
+    }
+    os<<"capsule main:\n    let total = 0;\n";
+    for (int f=0;f<funcs;f++) os<<"    total = total + f"<<f<<"("<<f%13<<", "<<f%7+1<<");\n";
+    os<<"end\n";
+    return os.str();
+}
+
+// Counts bytes instead of keeping them, so emit benches measure formatting.
+struct NullSink : EmitSink {
+    std::size_t bytes=0;
+    void write(const char*, std::size_t n) override { bytes+=n; }
+    using EmitSink::write;
+};
+
+struct BenchResult {
+    std::string name;
+    std::vector<double> ns;     // one per rep
+    std::uint64_t items=0;      // tokens, functions, bytes, timers... per rep
+    std::string unit;
+    double min() const { return *std::min_element(ns.begin(), ns.end()); }
+    double median() const { auto v=ns; std::sort(v.begin(), v.end()); return v[v.size()/2]; }
+    double mean() const { double s=0; for (double x : ns) s+=x; return s/ns.size(); }
+};
+
+static double nowNs(){
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// One untimed warm-up, then `reps` timed runs of fn; fn returns the item count.
+template<typename F> static BenchResult measure(const std::string& name, const char* unit, int reps, F fn){
+    BenchResult r; r.name=name; r.unit=unit;
+    r.items=fn();
+    for (int k=0;k<reps;k++){
+        double t0=nowNs(); fn(); r.ns.push_back(nowNs()-t0);
+    }
+    return r;
+}
+
+static std::string toJSON(const std::vector<BenchResult>& rs, int funcs, int depth, int iters, int reps){
+    std::ostringstream os; os.precision(12);
+    os<<"{\"config\":{\"funcs\":"<<funcs<<",\"depth\":"<<depth<<",\"iters\":"<<iters<<",\"reps\":"<<reps<<"},\n \"results\":[";
+    for (std::size_t k=0;k<rs.size();k++){
+        auto& r=rs[k];
+        os<<(k?",\n  ":"\n  ")<<"{\"name\":\""<<r.name<<"\",\"min_ns\":"<<r.min()<<",\"median_ns\":"<<r.median()
+          <<",\"mean_ns\":"<<r.mean()<<",\""<<r.unit<<"\":"<<r.items
+          <<",\"ns_per_item\":"<<(r.items ? r.median()/r.items : 0)<<"}";
+    }
+    os<<"\n]}\n";
+    return os.str();
+}
+
+// Stage name -> median_ns from a file written by toJSON.
+static bool loadBaseline(const std::string& path, std::map<std::string,double>& out){
+    std::ifstream in(path); if (!in) return false;
+    std::stringstream buf; buf<<in.rdbuf(); std::string s=buf.str();
+    for (std::size_t p=0; (p=s.find("\"name\":\"",p))!=std::string::npos; ){
+        p+=8; std::size_t q=s.find('"',p); if (q==std::string::npos) break;
+        std::string name=s.substr(p,q-p);
+        std::size_t m=s.find("\"median_ns\":",q), nextObj=s.find("\"name\":\"",q);
+        if (m!=std::string::npos && m<nextObj) out[name]=std::strtod(s.c_str()+m+12, nullptr);
+        p=q;
+    }
+    return true;
+}
+
+int main(int argc, char** argv){
+    int funcs=200, depth=16, iters=200, reps=5;
+    double threshold=10;
+    std::string outPath, baseline, emitSource, only;
+    for (int i=1;i<argc;i++){
+        std::string a=argv[i];
+        if (a.rfind("--funcs=",0)==0) funcs=std::stoi(a.substr(8));
+        else if (a.rfind("--depth=",0)==0) depth=std::stoi(a.substr(8));
+        else if (a.rfind("--iters=",0)==0) iters=std::stoi(a.substr(8));
+        else if (a.rfind("--reps=",0)==0) reps=std::max(1, std::stoi(a.substr(7)));
+        else if (a.rfind("--only=",0)==0) only=","+a.substr(7)+",";
+        else if (a.rfind("--out=",0)==0) outPath=a.substr(6);
+        else if (a.rfind("--baseline=",0)==0) baseline=a.substr(11);
+        else if (a.rfind("--threshold=",0)==0) threshold=std::stod(a.substr(12));
+        else if (a.rfind("--emit-source=",0)==0) emitSource=a.substr(14);
+        else { std::cerr<<"Usage: cmajor_bench [--funcs=N] [--depth=M] [--iters=K] [--reps=R] [--only=stage,...] [--out=file] [--baseline=file] [--threshold=PCT] [--emit-source=file]\n"; return 1; }
+    }
+    auto want=[&](const char* stage){ return only.empty() || only.find(std::string(",")+stage+",")!=std::string::npos; };
+
+    const std::string src=synthesize(funcs, depth, iters);
+    if (!emitSource.empty()){ std::ofstream(emitSource)<<src; }
+
+    // inputs for each stage come from one untimed pass of the stage before
+    Lexer lx0(src); const auto toks=lx0.tokenize();
+    Parser ps0(toks); const auto ast=ps0.parseProgram();
+    IRGen gen0; const IRModule mod=gen0.generate(ast);
+
+    std::vector<BenchResult> rs;
+    if (want("lex")) rs.push_back(measure("lex", "tokens", reps, [&]{ Lexer l(src); return l.tokenize().size(); }));
+    if (want("parse")) rs.push_back(measure("parse", "tokens", reps, [&]{ Parser p(toks); p.parseProgram(); return toks.size(); }));
+    if (want("irgen")) rs.push_back(measure("irgen", "functions", reps, [&]{ IRGen g; return g.generate(ast).funcs.size(); }));
+    if (want("hex")) rs.push_back(measure("hex", "bytes", reps, [&]{ NullSink s; emitHEX(mod, s); return s.bytes; }));
+    if (want("cil")) rs.push_back(measure("cil", "bytes", reps, [&]{ NullSink s; emitCIL(mod, s); return s.bytes; }));
+    if (want("vm")){
+        VM vm(mod);
+        rs.push_back(measure("vm", "iterations", reps, [&]{ vm.call("main"); return std::uint64_t(funcs)*iters; }));
+    }
+    if (want("pipeline")) rs.push_back(measure("pipeline", "bytes", reps, [&]{
+        Lexer l(src); auto t=l.tokenize();
+        Parser p(t); auto a=p.parseProgram();
+        IRGen g; IRModule m=g.generate(a);
+        VM vm(m); vm.call("main");
+        return src.size();
+    }));
+    const int timers=std::max(1000, funcs*100);
+    if (want("sched-schedule")) rs.push_back(measure("sched-schedule", "timers", reps, [&]{
+        Scheduler sc(1);
+        std::vector<std::uint64_t> ids; ids.reserve(timers);
+        for (int k=0;k<timers;k++) ids.push_back(sc.schedule({ []{} }, k%5000, {}));
+        for (auto id : ids) sc.cancel(id);
+        return std::uint64_t(timers);
+    }));
+    if (want("sched-fire")) rs.push_back(measure("sched-fire", "timers", reps, [&]{
+        Scheduler sc;
+        std::atomic<int> fired{0};
+        CapsuleMeta meta{ "bench", "cmajor_bench", {} };
+        for (int k=0;k<timers;k++) sc.schedule({ [&fired]{ fired.fetch_add(1, std::memory_order_relaxed); } }, k%8, meta);
+        std::thread th([&sc]{ sc.run(); });
+        sc.waitIdle(-1);
+        sc.stop(); th.join();
+        return std::uint64_t(fired.load());
+    }));
+    if (want("mutlog")){
+        MutationLog log;    // the warm-up pass creates this thread's ring
+        rs.push_back(measure("mutlog", "events", reps, [&]{
+            for (int k=0;k<timers;k++) log.record(MutationType::Executed, std::uint64_t(k), k);
+            return std::uint64_t(timers);
+        }));
+    }
+
+    std::string json=toJSON(rs, funcs, depth, iters, reps);
+    if (outPath.empty()) std::cout<<json;
+    else if (!(std::ofstream(outPath)<<json)){ std::cerr<<"Cannot write "<<outPath<<"\n"; return 1; }
+
+    int status=0;
+    if (!baseline.empty()){
+        std::map<std::string,double> old;
+        if (!loadBaseline(baseline, old)){ std::cerr<<"Cannot read baseline "<<baseline<<"\n"; return 1; }
+        for (auto& r : rs){
+            auto it=old.find(r.name);
+            if (it==old.end() || it->second<=0) continue;
+            double pct=(r.median()-it->second)*100/it->second;
+            bool slow=pct>threshold;
+            std::cerr<<(slow ? "REGRESSION " : "ok         ")<<r.name<<": "<<static_cast<long long>(it->second)
+                     <<" -> "<<static_cast<long long>(r.median())<<" ns ("<<(pct>=0?"+":"")<<static_cast<int>(pct)<<"%)\n";
+            if (slow) status=2;
+        }
+    }
+    OutputSink::instance().flush();
+    return status;
+}
@@ -1,5 +1,5 @@
 #include "EmitCIL.hpp"
-#include <sstream>
+#include <string>
 
 static const char* cilOp(IROp op){
     switch(op){
@@ -27,23 +27,38 @@ static const char* cilOp(IROp op){
         case IROp::CALL:   return "call";
         case IROp::RET:    return "ret";
         case IROp::PRINT:  return "call print";
+        case IROp::PARFOR: return "call parfor"; // pseudo
+        case IROp::SCHEDULE: return "call schedule"; // pseudo
+        case IROp::EVERY:  return "call every"; // pseudo
+        case IROp::VEC:    return "newobj vector"; // pseudo
+        case IROp::VADD:   return "call vadd"; // pseudo
+        case IROp::VMUL:   return "call vmul"; // pseudo
+        case IROp::VMIN:   return "call vmin"; // pseudo
+        case IROp::VMAX:   return "call vmax"; // pseudo
+        case IROp::VDOT:   return "call vdot"; // pseudo
+        case IROp::VCLAMP: return "call vclamp"; // pseudo
         default:           return "nop";
     }
 }
 
-std::string emitCIL(const IRModule& m){
-    std::ostringstream os;
-    os << "// CIL-like output (illustrative)\n";
-    for (auto& f : m.funcs){
-        os << ".method static void " << f.name << "() {\n";
-        for (auto& i : f.code){
-            os << "  " << cilOp(i.op);
-            if (!i.a.empty()) os << " " << i.a;
-            if (!i.b.empty()) os << ", " << i.b;
-            if (!i.c.empty()) os << ", " << i.c;
-            os << "\n";
-        }
-        os << "}\n\n";
+static void cilFunc(const IRFunction& f, std::string& out){
+    out += ".method static void "; out += f.name; out += "() {\n";
+    for (auto& i : f.code){
+        out += "  "; out += cilOp(i.op);
+        if (!i.a.empty()){ out += " "; out += i.a; }
+        if (!i.b.empty()){ out += ", "; out += i.b; }
+        if (!i.c.empty()){ out += ", "; out += i.c; }
+        out += "\n";
     }
-    return os.str();
+    out += "}\n\n";
+}
+
+void emitCIL(const IRModule& m, EmitSink& out, unsigned threads){
+    out.write("// CIL-like output (illustrative)\n");
+    emitFunctions(m, out, cilFunc, threads);
+}
+
+std::string emitCIL(const IRModule& m){
+    StringSink s; emitCIL(m, s, 1);
+    return s.out;
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "IR.hpp"
+#include "EmitSink.hpp"
 #include <string>
 
 std::string emitCIL(const IRModule& m);
+void emitCIL(const IRModule& m, EmitSink& out, unsigned threads=0);
@@ -1,8 +1,10 @@
 #include "EmitHEX.hpp"
-#include <sstream>
-#include <iomanip>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 // Tiny fake encoding mapping op -> 1 byte opcode; operands ascii-separated
+// (text) or packed as string-table indices (binary)
 static unsigned opByte(IROp op){
     switch(op){
         case IROp::ICONST: return 0x01; case IROp::FCONST: return 0x02; case IROp::SCONST: return 0x03;
@@ -11,20 +13,72 @@ static unsigned opByte(IROp op){
         case IROp::CMP_EQ: return 0x30; case IROp::CMP_NE: return 0x31; case IROp::CMP_LT: return 0x32; case IROp::CMP_LE: return 0x33; case IROp::CMP_GT: return 0x34; case IROp::CMP_GE: return 0x35;
         case IROp::AND:    return 0x40; case IROp::OR:     return 0x41; case IROp::NOT: return 0x42;
         case IROp::JMP:    return 0x50; case IROp::JZ:     return 0x51; case IROp::LABEL: return 0x52;
-        case IROp::CALL:   return 0x60; case IROp::RET:    return 0x61; case IROp::PRINT: return 0x70;
+        case IROp::CALL:   return 0x60; case IROp::RET:    return 0x61; case IROp::PARFOR: return 0x62;
+        case IROp::SCHEDULE: return 0x63; case IROp::EVERY: return 0x64;
+        case IROp::PRINT:  return 0x70;
+        case IROp::VEC:    return 0x80; case IROp::VADD:   return 0x81; case IROp::VMUL: return 0x82; case IROp::VMIN: return 0x83; case IROp::VMAX: return 0x84;
+        case IROp::VDOT:   return 0x85; case IROp::VCLAMP: return 0x86;
         default: return 0xFF;
     }
 }
 
-std::string emitHEX(const IRModule& m){
-    std::ostringstream os;
-    os << "; HEX OPCODE STREAM\n";
-    for (auto& f : m.funcs){
-        os << "; FUNC " << f.name << "\n";
-        for (auto& ins : f.code){
-            os << std::hex << std::setfill('0') << std::setw(2) << (int)opByte(ins.op) << " "
-               << ins.a << " " << ins.b << " " << ins.c << "\n";
-        }
+static void putULEB(std::string& out, unsigned long long v){
+    do { unsigned char b=v&0x7F; v>>=7; out+=static_cast<char>(v ? b|0x80 : b); } while (v);
+}
+
+// "%02x a b c\n" per instruction
+static void hexFunc(const IRFunction& f, std::string& out){
+    static const char digits[]="0123456789abcdef";
+    out += "; FUNC "; out += f.name; out += "\n";
+    for (auto& ins : f.code){
+        unsigned b=opByte(ins.op);
+        out += digits[b>>4]; out += digits[b&15]; out += ' ';
+        out += ins.a; out += ' '; out += ins.b; out += ' '; out += ins.c; out += '\n';
+    }
+}
+
+// Packed binary, per function: uleb name length + name, uleb string count
+// + (uleb length + bytes)..., uleb instruction count, then per instruction
+// the opcode byte and a, b, c as uleb (0 = empty, k+1 = string k). ICONST's
+// b is its value as a zigzag uleb instead of text.
+static void binFunc(const IRFunction& f, std::string& out){
+    std::vector<const std::string*> pool;
+    std::unordered_map<std::string, unsigned> ids;
+    auto id = [&](const std::string& s) -> unsigned {
+        if (s.empty()) return 0;
+        auto it=ids.find(s); if (it!=ids.end()) return it->second;
+        pool.push_back(&s); return ids[s]=static_cast<unsigned>(pool.size());
+    };
+    std::string code;
+    for (auto& ins : f.code){
+        code += static_cast<char>(opByte(ins.op));
+        putULEB(code, id(ins.a));
+        if (ins.op==IROp::ICONST){
+            long long v=std::stoll(ins.b);
+            putULEB(code, (static_cast<unsigned long long>(v)<<1) ^ static_cast<unsigned long long>(v>>63));
+        } else putULEB(code, id(ins.b));
+        putULEB(code, id(ins.c));
     }
-    return os.str();
+    putULEB(out, f.name.size()); out += f.name;
+    putULEB(out, pool.size());
+    for (auto* s : pool){ putULEB(out, s->size()); out += *s; }
+    putULEB(out, f.code.size());
+    out += code;
+}
+
+void emitHEX(const IRModule& m, EmitSink& out, HexMode mode, unsigned threads){
+    if (mode==HexMode::Binary){
+        // "CMHX", format version, uleb function count
+        std::string head="CMHX\x01"; putULEB(head, m.funcs.size());
+        out.write(head);
+        emitFunctions(m, out, binFunc, threads);
+        return;
+    }
+    out.write("; HEX OPCODE STREAM\n");
+    emitFunctions(m, out, hexFunc, threads);
+}
+
+std::string emitHEX(const IRModule& m){
+    StringSink s; emitHEX(m, s, HexMode::Text, 1);
+    return s.out;
 }
@@ -1,5 +1,9 @@
 #pragma once
 #include "IR.hpp"
+#include "EmitSink.hpp"
 #include <string>
 
+enum class HexMode { Text, Binary };
+
 std::string emitHEX(const IRModule& m);
+void emitHEX(const IRModule& m, EmitSink& out, HexMode mode=HexMode::Text, unsigned threads=0);
@@ -0,0 +1,97 @@
+#include "EmitSink.hpp"
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+FdSink::FdSink(int fd, bool owned, std::size_t cap) : fd(fd), owned(owned), cap(cap) {
+    buf.reserve(cap);
+}
+
+FdSink::~FdSink(){
+    flush();
+    if (owned) ::close(fd);
+}
+
+FdSink* FdSink::open(const std::string& path){
+    int fd = ::open(path.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    return fd<0 ? nullptr : new FdSink(fd, true);
+}
+
+void FdSink::write(const char* data, std::size_t n){
+    if (buf.size()+n > cap) flush();
+    if (n >= cap) { writeAll(data, n); return; }
+    buf.append(data, n);
+}
+
+void FdSink::flush(){
+    if (!buf.empty()) writeAll(buf.data(), buf.size());
+    buf.clear();
+}
+
+void FdSink::writeAll(const char* data, std::size_t n){
+    while (n && good){
+        ssize_t w = ::write(fd, data, n);
+        if (w<0){ if (errno==EINTR) continue; good=false; break; }
+        data+=w; n-=static_cast<std::size_t>(w);
+    }
+}
+
+void emitFunctions(const IRModule& m, EmitSink& out, const FuncFormatter& fmt, unsigned threads){
+    std::size_t n = m.funcs.size();
+    if (!threads) threads = std::thread::hardware_concurrency();
+    if (threads > n) threads = static_cast<unsigned>(n);
+    if (threads <= 1){
+        std::string buf;
+        for (auto& f : m.funcs){ buf.clear(); fmt(f, buf); out.write(buf); }
+        return;
+    }
+    // Workers claim functions in order but stay within `window` of the
+    // writer; the writer (this thread) drains slots strictly in order.
+    const std::size_t window = threads*4;
+    std::vector<std::string> slots(window);
+    std::vector<char> ready(window, 0);
+    std::mutex mtx; std::condition_variable cv;
+    std::size_t next=0, written=0;
+    std::exception_ptr failed;
+    auto work = [&]{
+        for(;;){
+            std::size_t k;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]{ return next>=n || next<written+window; });
+                if (next>=n) return;
+                k = next++;
+            }
+            std::string buf;
+            std::exception_ptr err;
+            try { fmt(m.funcs[k], buf); } catch (...) { err = std::current_exception(); }
+            std::lock_guard<std::mutex> lock(mtx);
+            if (err && !failed) failed = err;
+            slots[k%window] = std::move(buf);
+            ready[k%window] = 1;
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t=0;t<threads;t++) pool.emplace_back(work);
+    for (std::size_t k=0;k<n;k++){
+        std::string buf; bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]{ return ready[k%window]!=0; });
+            buf = std::move(slots[k%window]);
+            ready[k%window] = 0;
+            written = k+1;
+            stop = failed!=nullptr;
+        }
+        cv.notify_all();
+        if (!stop) out.write(buf);
+    }
+    for (auto& t : pool) t.join();
+    if (failed) std::rethrow_exception(failed);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "IR.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Destination for emitted code. Emitters hand it whole per-function
+// buffers in module order.
+struct EmitSink {
+    virtual ~EmitSink() = default;
+    virtual void write(const char* data, std::size_t n) = 0;
+    void write(const std::string& s){ write(s.data(), s.size()); }
+    virtual bool ok() const { return true; }
+    virtual void flush() {}
+};
+
+// Collects everything in memory (emitHEX/emitCIL string wrappers).
+struct StringSink : EmitSink {
+    std::string out;
+    void write(const char* data, std::size_t n) override { out.append(data, n); }
+    using EmitSink::write;
+};
+
+// Buffered writes straight to a file descriptor; small pieces are batched
+// into `cap`-byte write(2) calls, large ones go through unbuffered.
+class FdSink : public EmitSink {
+public:
+    explicit FdSink(int fd, bool owned=false, std::size_t cap=1<<20);
+    ~FdSink() override;
+    static FdSink* open(const std::string& path);   // nullptr on failure
+    void write(const char* data, std::size_t n) override;
+    using EmitSink::write;
+    bool ok() const override { return good; }
+    void flush() override;
+private:
+    int fd; bool owned; bool good=true;
+    std::size_t cap;
+    std::string buf;
+    void writeAll(const char* data, std::size_t n);
+};
+
+// Format every function of m with fmt on up to `threads` threads (0 = one
+// per core) and write the buffers to out in module order. At most a few
+// buffers per thread are held at once, so memory stays bounded.
+using FuncFormatter = std::function<void(const IRFunction&, std::string&)>;
+void emitFunctions(const IRModule& m, EmitSink& out, const FuncFormatter& fmt, unsigned threads=0);
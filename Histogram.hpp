@@ -0,0 +1,97 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Lock-free HDR-style histogram of non-negative integers (nanoseconds,
+// depths). Buckets are log-linear: exact below 2^SUB_BITS, then 64 linear
+// steps per power of two, so any recorded value is off by under 1%.
+// record() is a few relaxed atomic adds; snapshot() may run concurrently.
+
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;           // per bucket
+    uint64_t count = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    double mean = 0;
+
+    // Smallest recorded value v such that a fraction q of the samples are <= v.
+    uint64_t percentile(double q) const;
+};
+
+class HdrHistogram {
+public:
+    static constexpr int SUB_BITS = 7;
+    static constexpr int MAX_BITS = 44;     // ~4.9 hours in ns; larger values clamp
+    static constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+    static constexpr uint64_t HALF = SUB / 2;
+    static constexpr size_t BUCKETS = SUB + (MAX_BITS - SUB_BITS) * HALF;
+
+    HdrHistogram() : _counts(new std::atomic<uint64_t>[BUCKETS]) {
+        for (size_t i = 0; i < BUCKETS; ++i) _counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t v) {
+        v = std::min<uint64_t>(v, (uint64_t(1) << MAX_BITS) - 1);
+        _counts[index(v)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(v, std::memory_order_relaxed);
+        uint64_t lo = _min.load(std::memory_order_relaxed);
+        while (v < lo && !_min.compare_exchange_weak(lo, v, std::memory_order_relaxed)) {}
+        uint64_t hi = _max.load(std::memory_order_relaxed);
+        while (v > hi && !_max.compare_exchange_weak(hi, v, std::memory_order_relaxed)) {}
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        s.counts.resize(BUCKETS);
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            s.counts[i] = _counts[i].load(std::memory_order_relaxed);
+            s.count += s.counts[i];
+        }
+        if (s.count) {
+            s.min = _min.load(std::memory_order_relaxed);
+            s.max = _max.load(std::memory_order_relaxed);
+            s.mean = double(_sum.load(std::memory_order_relaxed)) / double(_count.load(std::memory_order_relaxed));
+        }
+        return s;
+    }
+
+    static size_t index(uint64_t v) {
+        if (v < SUB) return static_cast<size_t>(v);
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS + 1;
+        return static_cast<size_t>(SUB + (shift - 1) * HALF + ((v >> shift) - HALF));
+    }
+
+    // Highest value that lands in bucket i.
+    static uint64_t upper(size_t i) {
+        if (i < SUB) return i;
+        uint64_t k = i - SUB;
+        int shift = static_cast<int>(k / HALF) + 1;
+        uint64_t top = k % HALF + HALF;
+        return ((top + 1) << shift) - 1;
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> _counts;
+    std::atomic<uint64_t> _count{ 0 };
+    std::atomic<uint64_t> _sum{ 0 };
+    std::atomic<uint64_t> _min{ UINT64_MAX };
+    std::atomic<uint64_t> _max{ 0 };
+};
+
+inline uint64_t HistogramSnapshot::percentile(double q) const {
+    if (!count) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * double(count) + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(std::max(HdrHistogram::upper(i), min), max);
+    }
+    return max;
+}
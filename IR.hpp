@@ -10,16 +10,27 @@ enum class IROp {
     CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE,
     AND, OR, NOT,
     JMP, JZ, LABEL,
-    CALL, RET, PRINT
+    CALL, RET, PRINT, // CALL fn, dst, "arg1,arg2"; RET [src]
+    PARFOR,           // PARFOR body, "start,stop", "cap1,cap2": body(i, caps...) for i in [start, stop]
+    SCHEDULE,         // SCHEDULE capsule, delay, meta: run capsule() once after delay ms
+    EVERY,            // EVERY body, "interval,cap1,...", meta: run body(caps...) every interval ms
+    VEC,              // VEC dst, "x,y,...": vector of 1..8 lanes
+    VADD, VMUL, VMIN, VMAX, // dst, a, b: lane-wise; a number is broadcast over the other side
+    VDOT,             // VDOT dst, a, b: sum of the lane products
+    VCLAMP            // VCLAMP dst, "v,lo,hi": lane-wise min(max(v, lo), hi)
 };
 
+// Timer ops name their CapsuleMeta as "name|origin|q1,q2".
+
 struct IRInst {
     IROp op;
     std::string a, b, c; // generic operands (regs, imm, labels, names)
+    int line = 0;        // source line of the statement, 0 = unknown
 };
 
 struct IRFunction {
     std::string name;
+    std::vector<std::string> params;
     std::vector<IRInst> code;
 };
 
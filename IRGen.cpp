@@ -1,21 +1,35 @@
 #include "IRGen.hpp"
+#include "PassStats.hpp"
 #include <stdexcept>
+#include <set>
 
 IRModule IRGen::generate(ASTPtr root){
     // implicit main if capsule 'main' exists: create wrapper calling it
-    for (auto& n : root->kids){
-        if (n->kind==ASTKind::Func){
-            IRFunction f; f.name = n->name; mod.funcs.push_back(std::move(f));
-        }
-        if (n->kind==ASTKind::Capsule){
-            IRFunction f; f.name = n->name; mod.funcs.push_back(std::move(f));
+    {
+        PassStats::Scope pass(stats, "declare");
+        for (auto& n : root->kids){
+            if (n->kind==ASTKind::Func){
+                IRFunction f; f.name = n->name;
+                for (auto& k : n->kids) if (k->kind==ASTKind::Param) f.params.push_back(k->name);
+                mod.funcs.push_back(std::move(f));
+            }
+            if (n->kind==ASTKind::Capsule){
+                IRFunction f; f.name = n->name; mod.funcs.push_back(std::move(f));
+                std::string quals;
+                for (auto& q : n->qualifiers) quals += (quals.empty() ? "" : ",") + q;
+                metas[n->name] = n->name+"|"+n->literal+"|"+quals;
+            }
         }
     }
+    { PassStats::Scope pass(stats, "purity"); computePurity(root); }
     // fill bodies
+    PassStats::Scope lower(stats, "lower");
     for (auto& n : root->kids){
         for (auto& f : mod.funcs){
             if ((n->kind==ASTKind::Func || n->kind==ASTKind::Capsule) && f.name==n->name){
-                cur = &f;
+                cur = &f; curAst = n;
+                vecs.clear();
+                for (auto& k : n->kids) if (k->kind==ASTKind::Param && k->op=="vector") vecs.insert(k->name);
                 // body is last child for func, all kids for capsule
                 if (n->kind==ASTKind::Func){
                     auto body = n->kids.back();
@@ -28,6 +42,9 @@ IRModule IRGen::generate(ASTPtr root){
             }
         }
     }
+    // outlined loop bodies go last so `cur` stayed valid while lowering
+    for (auto& f : outlined) mod.funcs.push_back(std::move(f));
+    outlined.clear();
     // main wrapper if not present
     bool hasMain=false;
     for (auto& f : mod.funcs) if (f.name=="main") hasMain=true;
@@ -44,9 +61,9 @@ std::string IRGen::genExpr(ASTPtr e){
     switch (e->kind){
         case ASTKind::Literal: {
             auto t = newTmp();
-            // naive: decide by first char
+            // naive: decide by first char; a '.' makes it a Float literal
             if (!e->literal.empty() && std::isdigit((unsigned char)e->literal[0]))
-                cur->code.push_back({IROp::ICONST,t,e->literal});
+                cur->code.push_back({e->literal.find('.')!=std::string::npos ? IROp::FCONST : IROp::ICONST,t,e->literal});
             else
                 cur->code.push_back({IROp::SCONST,t,e->literal});
             return t;
@@ -54,10 +71,12 @@ std::string IRGen::genExpr(ASTPtr e){
         case ASTKind::Var: {
             auto t=newTmp();
             cur->code.push_back({IROp::LOAD,t,e->name});
+            if (vecs.count(e->name)) vecs.insert(t);
             return t;
         }
         case ASTKind::Unary: {
             auto r = genExpr(e->kids[0]);
+            if (vecs.count(r)) throw std::runtime_error("unary '"+e->op+"' is not defined for vectors");
             if (e->op=="-"){ auto t=newTmp(); cur->code.push_back({IROp::ICONST,t,"0"}); auto t2=newTmp(); cur->code.push_back({IROp::SUB,t2,t,r}); return t2; }
             if (e->op=="!"){ auto t=newTmp(); cur->code.push_back({IROp::NOT,t,r}); return t; }
             throw std::runtime_error("unary op not handled");
@@ -66,7 +85,13 @@ std::string IRGen::genExpr(ASTPtr e){
             auto a = genExpr(e->kids[0]);
             auto b = genExpr(e->kids[1]);
             auto t = newTmp();
-            if (e->op=="+") cur->code.push_back({IROp::ADD,t,a,b});
+            auto text = [](const ASTPtr& k){ return k->kind==ASTKind::Literal && !k->literal.empty() && !std::isdigit((unsigned char)k->literal[0]); };
+            if ((vecs.count(a) || vecs.count(b)) && !(e->op=="+" && (text(e->kids[0]) || text(e->kids[1])))){
+                if (e->op!="+" && e->op!="*") throw std::runtime_error("operator '"+e->op+"' is not defined for vectors");
+                cur->code.push_back({e->op=="+" ? IROp::VADD : IROp::VMUL,t,a,b});
+                vecs.insert(t);
+            }
+            else if (e->op=="+") cur->code.push_back({IROp::ADD,t,a,b});
             else if (e->op=="-") cur->code.push_back({IROp::SUB,t,a,b});
             else if (e->op=="*") cur->code.push_back({IROp::MUL,t,a,b});
             else if (e->op=="/") cur->code.push_back({IROp::DIV,t,a,b});
@@ -82,10 +107,15 @@ std::string IRGen::genExpr(ASTPtr e){
         }
         case ASTKind::Call: {
             // kids[0] = callee (Var or expr), kids[1..] args
-            // emit args then CALL
-            for (size_t k=1;k<e->kids.size();++k) (void)genExpr(e->kids[k]);
-            cur->code.push_back({IROp::CALL, e->kids[0]->name});
-            auto t=newTmp(); cur->code.push_back({IROp::ICONST,t,"0"}); // placeholder ret
+            // emit args then CALL callee, result, "a0,a1,..."
+            if (isBuiltin(e->kids[0]->name) && !declared(e->kids[0]->name)) return genBuiltin(e);
+            std::string args;
+            for (size_t k=1;k<e->kids.size();++k){
+                if (k>1) args+=",";
+                args+=genExpr(e->kids[k]);
+            }
+            auto t=newTmp();
+            cur->code.push_back({IROp::CALL, e->kids[0]->name, t, args});
             return t;
         }
         default: throw std::runtime_error("expr kind not supported");
@@ -93,27 +123,45 @@ std::string IRGen::genExpr(ASTPtr e){
 }
 
 void IRGen::genStmt(ASTPtr s){
+    // whatever this statement emits, minus what nested statements claimed, gets its line
+    struct LineFill {
+        IRFunction* f; std::size_t from; int line;
+        ~LineFill(){ for (auto k=from;k<f->code.size();++k) if (!f->code[k].line) f->code[k].line=line; }
+    } fill{cur, cur->code.size(), s->line};
     switch (s->kind){
         case ASTKind::Let: {
             auto r = genExpr(s->kids[0]);
             cur->code.push_back({IROp::STORE,s->name,r});
+            if (vecs.count(r)) vecs.insert(s->name);
             break;
         }
         case ASTKind::Assign: {
             auto r = genExpr(s->kids[0]);
             cur->code.push_back({IROp::STORE,s->name,r});
+            if (vecs.count(r)) vecs.insert(s->name);
             break;
         }
         case ASTKind::Return: {
             if (!s->kids.empty()){
                 auto r = genExpr(s->kids[0]);
-                cur->code.push_back({IROp::LOAD,"_ret",r});
+                cur->code.push_back({IROp::RET,r});  // CALL t; RET t is a tail call
+            } else {
+                cur->code.push_back({IROp::RET});
             }
-            cur->code.push_back({IROp::RET});
             break;
         }
         case ASTKind::Say: {
-            cur->code.push_back({IROp::PRINT,s->literal});
+            if (!s->kids.empty()) cur->code.push_back({IROp::PRINT,genExpr(s->kids[0])});
+            else cur->code.push_back({IROp::PRINT,s->literal});
+            break;
+        }
+        case ASTKind::Schedule: {
+            auto delay = genExpr(s->kids[0]);
+            cur->code.push_back({IROp::SCHEDULE,s->name,delay,metaOf(s->name)});
+            break;
+        }
+        case ASTKind::Every: {
+            genEvery(s);
             break;
         }
         case ASTKind::If: {
@@ -129,6 +177,11 @@ void IRGen::genStmt(ASTPtr s){
             break;
         }
         case ASTKind::Loop: {
+            auto info = analyzeLoop(s);
+            bool blocked = info.effects || !info.outerStore.empty();
+            if (s->parallel && !info.outerStore.empty())
+                throw std::runtime_error("parallel loop over '"+s->name+"' writes '"+info.outerStore+"' outside its body");
+            if (s->parallel || (autoParallel && !blocked)){ genParLoop(s, info); break; }
             auto Lbeg = newLbl(), Lend = newLbl();
             // s->name is loop var
             auto start = genExpr(s->kids[0]);
@@ -165,3 +218,198 @@ void IRGen::genStmt(ASTPtr s){
 void IRGen::genBlock(ASTPtr b){
     for (auto& k : b->kids) genStmt(k);
 }
+
+
+// ---- Parallel loops ----
+// A counted loop can run its iterations on the VM's thread pool when the
+// body only writes names that are private to it, does not `say`, does not
+// `return`, and only calls functions proven pure. `parallel loop` skips the
+// effect check; the VM then replays each chunk's output in iteration order.
+
+namespace {
+struct Names { std::set<std::string> reads, writes; bool says=false, returns=false, timers=false; std::set<std::string> calls; };
+
+void collect(ASTPtr n, Names& out, ASTPtr skip=nullptr){
+    if (!n || n==skip) return;
+    switch (n->kind){
+        case ASTKind::Let: case ASTKind::Assign: case ASTKind::Loop: case ASTKind::Param:
+            out.writes.insert(n->name); break;
+        case ASTKind::Var:    out.reads.insert(n->name); break;
+        case ASTKind::Say:    out.says = true; break;
+        case ASTKind::Return: out.returns = true; break;
+        case ASTKind::Schedule: case ASTKind::Every: out.timers = true; break;
+        case ASTKind::Call:   out.calls.insert(n->kids[0]->name);
+                              for (size_t k=1;k<n->kids.size();++k) collect(n->kids[k],out,skip);
+                              return;
+        default: break;
+    }
+    for (auto& k : n->kids) collect(k,out,skip);
+}
+}
+
+void IRGen::computePurity(ASTPtr root){
+    std::unordered_map<std::string,Names> body;
+    for (auto& n : root->kids)
+        if (n->kind==ASTKind::Func){ collect(n, body[n->name]); pure[n->name] = !body[n->name].says && !body[n->name].timers; }
+    // drop functions that reach an impure or unknown callee until stable
+    for (bool changed=true; changed;){
+        changed=false;
+        for (auto& f : body){
+            if (!pure[f.first]) continue;
+            for (auto& c : f.second.calls){
+                auto it = pure.find(c);
+                if (it==pure.end() ? !isBuiltin(c) : !it->second){ pure[f.first]=false; changed=true; break; }
+            }
+        }
+    }
+}
+
+IRGen::LoopInfo IRGen::analyzeLoop(ASTPtr loop){
+    LoopInfo info;
+    Names in, outside;
+    auto body = loop->kids[2];
+    collect(body, in);
+    collect(curAst, outside, loop);
+    // loop bounds are evaluated outside the body
+    collect(loop->kids[0], outside); collect(loop->kids[1], outside);
+    outside.writes.insert(loop->name);
+
+    info.effects = in.says || in.returns || in.timers;
+    for (auto& c : in.calls){ auto it=pure.find(c); if (it==pure.end() ? !isBuiltin(c) : !it->second) info.effects=true; }
+    if (in.returns && loop->parallel)
+        throw std::runtime_error("parallel loop over '"+loop->name+"' cannot return");
+    for (auto& w : in.writes)
+        if (outside.writes.count(w) || outside.reads.count(w)){ info.outerStore = w; break; }
+    for (auto& r : in.reads)
+        if (r!=loop->name && !in.writes.count(r) && outside.writes.count(r)) info.captures.push_back(r);
+    return info;
+}
+
+void IRGen::genParLoop(ASTPtr s, const LoopInfo& info){
+    // outline body(i, captures...) and hand the range to PARFOR
+    IRFunction body; body.name = cur->name+"$par"+std::to_string(par++);
+    body.params.push_back(s->name);
+    for (auto& c : info.captures) body.params.push_back(c);
+    auto start = genExpr(s->kids[0]);
+    auto stop  = genExpr(s->kids[1]);
+    std::string caps;
+    for (auto& c : info.captures){
+        auto t=newTmp(); cur->code.push_back({IROp::LOAD,t,c});
+        if (!caps.empty()) caps+=",";
+        caps+=t;
+    }
+    cur->code.push_back({IROp::STORE,s->name,start});
+    cur->code.push_back({IROp::PARFOR,body.name,start+","+stop,caps});
+    // leave the loop variable where the serial loop would: stop+1 if any iteration ran
+    auto Lskip=newLbl();
+    auto cmp=newTmp(); cur->code.push_back({IROp::CMP_LE,cmp,start,stop});
+    cur->code.push_back({IROp::JZ,cmp,Lskip});
+    auto one=newTmp(); cur->code.push_back({IROp::ICONST,one,"1"});
+    auto last=newTmp(); cur->code.push_back({IROp::ADD,last,stop,one});
+    cur->code.push_back({IROp::STORE,s->name,last});
+    cur->code.push_back({IROp::LABEL,Lskip});
+
+    IRFunction* outer = cur;
+    cur = &body;
+    genStmt(s->kids[2]);
+    cur->code.push_back({IROp::RET});
+    cur = outer;
+    outlined.push_back(std::move(body));
+}
+
+
+// ---- Timers ----
+// `schedule c after ms` registers one call of c; `every ms: ... end`
+// outlines its body into <fn>$everyN(captures...) and registers it as a
+// repeating timer. Captures are the values at registration time, so the
+// body may not write names that live outside it.
+
+std::string IRGen::metaOf(const std::string& name){
+    auto it = metas.find(name);
+    return it!=metas.end() ? it->second : name+"||";
+}
+
+void IRGen::genEvery(ASTPtr s){
+    Names in, outside;
+    collect(s->kids[1], in);
+    collect(curAst, outside, s);
+    collect(s->kids[0], outside);
+    if (in.returns) throw std::runtime_error("every block in '"+curAst->name+"' cannot return");
+    for (auto& w : in.writes)
+        if (outside.writes.count(w) || outside.reads.count(w))
+            throw std::runtime_error("every block in '"+curAst->name+"' writes '"+w+"' outside its body");
+    std::vector<std::string> captures;
+    for (auto& r : in.reads)
+        if (!in.writes.count(r) && outside.writes.count(r)) captures.push_back(r);
+
+    IRFunction body; body.name = cur->name+"$every"+std::to_string(par++);
+    std::string list = genExpr(s->kids[0]);
+    for (auto& c : captures){
+        body.params.push_back(c);
+        auto t=newTmp(); cur->code.push_back({IROp::LOAD,t,c});
+        list += ","+t;
+    }
+    cur->code.push_back({IROp::EVERY,body.name,list,metaOf(curAst->name)});
+
+    IRFunction* outer = cur;
+    cur = &body;
+    genStmt(s->kids[1]);
+    cur->code.push_back({IROp::RET});
+    cur = outer;
+    outlined.push_back(std::move(body));
+}
+
+
+// ---- Vectors ----
+// vec2(x, y) .. vec8(...) build a vector (one argument fills every lane);
+// dot(a, b), and min(a, b), max(a, b), clamp(v, lo, hi), which work lane
+// by lane when an argument is a vector. A function of the same name in the
+// module wins. `vector` parameters, the builtins' results and names
+// assigned from them are known to be vectors; `+` and `*` on those lower
+// to VADD / VMUL, and other operators are rejected here. Anything not
+// known falls back to the VM's run-time checks.
+
+static int vecWidth(const std::string& name){
+    if (name.size()==4 && name.compare(0,3,"vec")==0 && name[3]>='2' && name[3]<='8') return name[3]-'0';
+    return 0;
+}
+
+bool IRGen::isBuiltin(const std::string& name){
+    return vecWidth(name) || name=="dot" || name=="min" || name=="max" || name=="clamp";
+}
+
+bool IRGen::declared(const std::string& name) const {
+    for (auto& f : mod.funcs) if (f.name==name) return true;
+    return false;
+}
+
+std::string IRGen::genBuiltin(ASTPtr e){
+    auto name = e->kids[0]->name;
+    std::size_t argc = e->kids.size()-1;
+    int width = vecWidth(name);
+    std::size_t need = width ? static_cast<std::size_t>(width) : name=="clamp" ? 3 : 2;
+    if (argc!=need && !(width && argc==1))
+        throw std::runtime_error(name+"() takes "+std::to_string(need)+" arguments");
+    std::vector<std::string> args;
+    bool anyVec = false;
+    for (size_t k=1;k<e->kids.size();++k){
+        args.push_back(genExpr(e->kids[k]));
+        if (vecs.count(args.back())) anyVec = true;
+    }
+    auto t = newTmp();
+    if (width){
+        if (anyVec) throw std::runtime_error(name+"() takes numbers, not vectors");
+        std::string lanes;
+        for (int k=0;k<width;++k) lanes += (k ? "," : "")+args[argc==1 ? 0 : k];
+        cur->code.push_back({IROp::VEC,t,lanes});
+        vecs.insert(t);
+    } else if (name=="clamp"){
+        cur->code.push_back({IROp::VCLAMP,t,args[0]+","+args[1]+","+args[2]});
+        if (anyVec) vecs.insert(t);
+    } else {
+        IROp op = name=="dot" ? IROp::VDOT : name=="min" ? IROp::VMIN : IROp::VMAX;
+        cur->code.push_back({op,t,args[0],args[1]});
+        if (anyVec && op!=IROp::VDOT) vecs.insert(t);
+    }
+    return t;
+}
@@ -2,12 +2,22 @@
 #include "AST.hpp"
 #include "IR.hpp"
 #include <string>
+#include <vector>
 #include <unordered_map>
+#include <unordered_set>
+
+struct PassStats;
 
 struct IRGen {
     IRModule mod;
     IRFunction* cur = nullptr;
-    int tmp = 0, lbl=0;
+    ASTPtr curAst;                  // func/capsule being lowered
+    int tmp = 0, lbl=0, par=0;
+    bool autoParallel = true;       // outline provably independent loops
+    PassStats* stats = nullptr;     // --time-passes: times each pass when set
+    std::unordered_map<std::string,bool> pure;  // func -> no say, pure callees
+    std::vector<IRFunction> outlined;           // parallel loop / every bodies
+    std::unordered_map<std::string,std::string> metas;  // capsule -> timer meta
 
     std::string newTmp(){ return "%t"+std::to_string(tmp++); }
     std::string newLbl(){ return "L"+std::to_string(lbl++); }
@@ -18,5 +28,25 @@ struct IRGen {
     std::string genExpr(ASTPtr e);
     void genStmt(ASTPtr s);
     void genBlock(ASTPtr b);
+
+    // parallel loops
+    struct LoopInfo {
+        bool effects=false;             // say / impure call in body
+        std::string outerStore;         // first store to a name live outside the body
+        std::vector<std::string> captures;
+    };
+    void computePurity(ASTPtr root);
+    LoopInfo analyzeLoop(ASTPtr loop);
+    void genParLoop(ASTPtr s, const LoopInfo& info);
+
+    // timers
+    std::string metaOf(const std::string& name);
+    void genEvery(ASTPtr s);
+
+    // vectors
+    std::unordered_set<std::string> vecs;   // registers / variables of the current func known to hold vectors
+    static bool isBuiltin(const std::string& name);
+    bool declared(const std::string& name) const;
+    std::string genBuiltin(ASTPtr call);
 };
 
@@ -1,276 +1,137 @@
-#include <string>
-#include <vector>
+#include "Lexer.hpp"
 #include <cctype>
-#include <unordered_set>
+#include <stdexcept>
 #include <unordered_map>
 
-enum class TokenType {
-    Identifier,
-    Keyword,
-    Number,
-    String,
-    Operator,
-    Delimiter,
-    Comment,
-    Whitespace,
-    EndOfFile,
-    Unknown
-};
-
-struct Token {
-    TokenType type;
-    std::string value;
-    int line;
-    int column;
-};
-
-class Lexer {
-public:
-    Lexer(const std::string& input)
-        : input(input), pos(0), line(1), col(1) {}
-
-    std::vector<Token> tokenize() {
-        std::vector<Token> tokens;
-        while (true) {
-            Token token = nextToken();
-            if (token.type == TokenType::EndOfFile)
-                break;
-            if (token.type != TokenType::Whitespace && token.type != TokenType::Comment)
-                tokens.push_back(token);
-        }
-        return tokens;
-    }
-
-private:
-    const std::string input;
-    size_t pos;
-    int line, col;
-
-    const std::unordered_set<std::string> keywords = {
-        "if", "else", "while", "for", "return", "break", "continue",
-        "int", "float", "char", "string", "void", "bool", "true", "false"
-    };
-
-    const std::unordered_set<char> delimiters = {
-        '(', ')', '{', '}', '[', ']', ';', ',', '.'
-    };
-
-    const std::unordered_set<std::string> operators = {
-        "+", "-", "*", "/", "%", "=", "==", "!=", "<", "<=", ">", ">=", "&&", "||", "!", "&", "|"
+static const std::unordered_map<std::string, TokenType>& keywords(){
+    static const std::unordered_map<std::string, TokenType> kw = {
+        {"capsule", TokenType::KwCapsule}, {"func", TokenType::KwFunc},
+        {"struct", TokenType::KwStruct}, {"class", TokenType::KwClass},
+        {"let", TokenType::KwLet}, {"return", TokenType::KwReturn},
+        {"if", TokenType::KwIf}, {"else", TokenType::KwElse},
+        {"loop", TokenType::KwLoop}, {"from", TokenType::KwFrom}, {"to", TokenType::KwTo},
+        {"say", TokenType::KwSay}, {"end", TokenType::KwEnd},
+        {"parallel", TokenType::KwParallel},
+        {"schedule", TokenType::KwSchedule}, {"after", TokenType::KwAfter}, {"every", TokenType::KwEvery},
     };
+    return kw;
+}
 
-    char peek(int offset = 0) const {
-        if (pos + offset >= input.size()) return '\0';
-        return input[pos + offset];
-    }
+Lexer::Lexer(const std::string& source) : src(source) {}
 
-    char get() {
-        if (pos >= input.size()) return '\0';
-        char c = input[pos++];
-        if (c == '\n') { line++; col = 1; }
-        else col++;
-        return c;
-    }
+char Lexer::peek() const { return pos<src.size() ? src[pos] : '\0'; }
 
-    void unget() {
-        if (pos == 0) return;
-        pos--;
-        if (input[pos] == '\n') line--, col = 1; // Approximate, not perfect
-        else col--;
-    }
+char Lexer::advance(){
+    char c = src[pos++];
+    if (c=='\n'){ line++; column = 1; } else column++;
+    return c;
+}
 
-    void skipWhitespace() {
-        while (std::isspace(peek())) get();
-    }
+bool Lexer::match(char expected){
+    if (peek()!=expected) return false;
+    advance();
+    return true;
+}
 
-    Token nextToken() {
-        skipWhitespace();
-        int startLine = line, startCol = col;
+// Spaces, // line comments and /* block comments */.
+void Lexer::skipWhitespace(){
+    for (;;){
         char c = peek();
-
-        if (c == '\0')
-            return {TokenType::EndOfFile, "", line, col};
-
-        // Comments
-        if (c == '/' && peek(1) == '/') {
-            while (peek() != '\n' && peek() != '\0') get();
-            return {TokenType::Comment, "", startLine, startCol};
-        }
-        if (c == '/' && peek(1) == '*') {
-            get(); get(); // consume /*
-            while (!(peek() == '*' && peek(1) == '/') && peek() != '\0') get();
-            if (peek() == '*' && peek(1) == '/') { get(); get(); }
-            return {TokenType::Comment, "", startLine, startCol};
-        }
-
-        // Identifiers & Keywords
-        if (std::isalpha(c) || c == '_') {
-            std::string value;
-            while (std::isalnum(peek()) || peek() == '_')
-                value += get();
-            if (keywords.count(value))
-                return {TokenType::Keyword, value, startLine, startCol};
-            else
-                return {TokenType::Identifier, value, startLine, startCol};
-        }
-
-        // Numbers (integer and float)
-        if (std::isdigit(c)) {
-            std::string value;
-            bool isFloat = false;
-            while (std::isdigit(peek())) value += get();
-            if (peek() == '.') {
-                isFloat = true;
-                value += get();
-                while (std::isdigit(peek())) value += get();
-            }
-            return {TokenType::Number, value, startLine, startCol};
-        }
-
-        // String literals
-        if (c == '"') {
-            std::string value;
-            get(); // consume "
-            while (peek() != '"' && peek() != '\0') {
-                if (peek() == '\\') { // handle escape
-                    value += get();
-                    if (peek() != '\0') value += get();
-                } else {
-                    value += get();
-                }
-            }
-            if (peek() == '"') get();
-            return {TokenType::String, value, startLine, startCol};
+        if (c && std::isspace(static_cast<unsigned char>(c))) advance();
+        else if (c=='/' && pos+1<src.size() && src[pos+1]=='/'){ while (peek() && peek()!='\n') advance(); }
+        else if (c=='/' && pos+1<src.size() && src[pos+1]=='*'){
+            int at = line;
+            advance(); advance();
+            while (peek() && !(peek()=='*' && pos+1<src.size() && src[pos+1]=='/')) advance();
+            if (!peek()) throw std::runtime_error("Unterminated comment at line "+std::to_string(at));
+            advance(); advance();
         }
-
-        // Char literals
-        if (c == '\'') {
-            std::string value;
-            get(); // consume '
-            if (peek() == '\\') { value += get(); value += get(); }
-            else value += get();
-            if (peek() == '\'') get();
-            return {TokenType::String, value, startLine, startCol};
-        }
-
-        // Operators (longest match)
-        for (int len = 2; len >= 1; --len) {
-            std::string op;
-            for (int i = 0; i < len; ++i) op += peek(i);
-            if (operators.count(op)) {
-                for (int i = 0; i < len; ++i) get();
-                return {TokenType::Operator, op, startLine, startCol};
-            }
-        }
-
-        // Delimiters
-        if (delimiters.count(c)) {
-            get();
-            return {TokenType::Delimiter, std::string(1, c), startLine, startCol};
-        }
-
-        // Whitespace (should be skipped, but for completeness)
-        if (std::isspace(c)) {
-            get();
-            return {TokenType::Whitespace, " ", startLine, startCol};
-        }
-
-        // Unknown
-        get();
-        return {TokenType::Unknown, std::string(1, c), startLine, startCol};
-    }
-};
-
-// --- Lexer Enhancements ---
-
-namespace LexerFixes {
-
-bool isValidEscape(char c) {
-    return c == 'n' || c == 't' || c == '\\' || c == '\'' || c == '\"' || c == 'r' || c == '0';
-}
-
-std::string decodeEscape(char c) {
-    switch (c) {
-        case 'n': return "\n";
-        case 't': return "\t";
-        case '\\': return "\\";
-        case '\'': return "\'";
-        case '\"': return "\"";
-        case 'r': return "\r";
-        case '0': return "\0";
-        default: return std::string(1, c);
+        else return;
     }
 }
 
-// Patch for unget() to track previous line lengths
-class LineTracker {
-    std::vector<int> lineLengths;
-public:
-    void record(int col) { lineLengths.push_back(col); }
-    int previous() {
-        if (lineLengths.empty()) return 1;
-        int len = lineLengths.back();
-        lineLengths.pop_back();
-        return len;
-    }
-};
-
-LineTracker tracker;
+Token Lexer::makeToken(TokenType type, const std::string& lexeme){ return {type, lexeme, line, column}; }
 
-void enhancedUnget(Lexer& lexer, const std::string& input) {
-    if (lexer.pos == 0) return;
-    lexer.pos--;
-    if (input[lexer.pos] == '\n') {
-        lexer.line--;
-        lexer.col = tracker.previous();
-    } else {
-        lexer.col--;
-    }
+Token Lexer::identifier(){
+    int l = line, c = column;
+    std::size_t start = pos;
+    while (std::isalnum(static_cast<unsigned char>(peek())) || peek()=='_') advance();
+    std::string word = src.substr(start, pos-start);
+    auto it = keywords().find(word);
+    return {it==keywords().end() ? TokenType::Identifier : it->second, word, l, c};
 }
 
-// Enhanced string parser
-Token parseString(Lexer& lexer) {
-    int startLine = lexer.line, startCol = lexer.col;
-    std::string value;
-    lexer.get(); // consume opening "
+// 42 or 4.2; a '.' not followed by a digit is left alone.
+Token Lexer::number(){
+    int l = line, c = column;
+    std::size_t start = pos;
+    while (std::isdigit(static_cast<unsigned char>(peek()))) advance();
+    bool frac = peek()=='.' && pos+1<src.size() && std::isdigit(static_cast<unsigned char>(src[pos+1]));
+    if (frac){ advance(); while (std::isdigit(static_cast<unsigned char>(peek()))) advance(); }
+    return {frac ? TokenType::Float : TokenType::Number, src.substr(start, pos-start), l, c};
+}
 
-    while (lexer.peek() != '\"' && lexer.peek() != '\0') {
-        if (lexer.peek() == '\\') {
-            lexer.get(); // consume '\'
-            char esc = lexer.get();
-            if (isValidEscape(esc))
-                value += decodeEscape(esc);
-            else
-                value += esc; // fallback
-        } else {
-            value += lexer.get();
+// "..." with \n \t \r \0 \\ \" escapes; the lexeme is the decoded text.
+Token Lexer::string(){
+    int l = line, c = column;
+    advance();
+    std::string text;
+    while (peek() && peek()!='"' && peek()!='\n'){
+        char ch = advance();
+        if (ch!='\\'){ text += ch; continue; }
+        if (!peek()) break;
+        switch (char e = advance()){
+        case 'n': text += '\n'; break;
+        case 't': text += '\t'; break;
+        case 'r': text += '\r'; break;
+        case '0': text += '\0'; break;
+        default: text += e; break;
         }
     }
-
-    if (lexer.peek() == '\"') lexer.get(); // consume closing "
-    else return {TokenType::Unknown, value, startLine, startCol}; // unterminated
-
-    return {TokenType::String, value, startLine, startCol};
+    if (!match('"')) throw std::runtime_error("Unterminated string at line "+std::to_string(l));
+    return {TokenType::String, text, l, c};
 }
 
-// Enhanced char parser
-Token parseChar(Lexer& lexer) {
-    int startLine = lexer.line, startCol = lexer.col;
-    std::string value;
-    lexer.get(); // consume opening '
-
-    if (lexer.peek() == '\\') {
-        lexer.get();
-        char esc = lexer.get();
-        value = decodeEscape(esc);
-    } else {
-        value += lexer.get();
+std::vector<Token> Lexer::tokenize(){
+    std::vector<Token> out;
+    for (;;){
+        skipWhitespace();
+        char c = peek();
+        if (!c) break;
+        if (std::isalpha(static_cast<unsigned char>(c)) || c=='_'){ out.push_back(identifier()); continue; }
+        if (std::isdigit(static_cast<unsigned char>(c))){ out.push_back(number()); continue; }
+        if (c=='"'){ out.push_back(string()); continue; }
+        int l = line, col = column;
+        advance();
+        TokenType t = TokenType::Unknown;
+        std::string lx(1, c);
+        auto two = [&](char next, TokenType both, TokenType one){
+            if (match(next)){ lx += next; t = both; } else t = one;
+        };
+        switch (c){
+        case '(': t = TokenType::LParen; break;
+        case ')': t = TokenType::RParen; break;
+        case '{': t = TokenType::LBrace; break;
+        case '}': t = TokenType::RBrace; break;
+        case ':': t = TokenType::Colon; break;
+        case ';': t = TokenType::Semicolon; break;
+        case ',': t = TokenType::Comma; break;
+        case '^': t = TokenType::Caret; break;
+        case '~': t = TokenType::Tilde; break;
+        case '%': t = TokenType::Percent; break;
+        case '+': two('=', TokenType::PlusEq, TokenType::Plus); break;
+        case '-': two('=', TokenType::MinusEq, TokenType::Minus); break;
+        case '*': two('=', TokenType::StarEq, TokenType::Star); break;
+        case '/': two('=', TokenType::SlashEq, TokenType::Slash); break;
+        case '<': two('=', TokenType::LessEq, TokenType::Less); break;
+        case '>': two('=', TokenType::GreaterEq, TokenType::Greater); break;
+        case '=': two('=', TokenType::EqEq, TokenType::Assign); break;
+        case '!': two('=', TokenType::BangEq, TokenType::Bang); break;
+        case '&': two('&', TokenType::AndAnd, TokenType::Amp); break;
+        case '|': two('|', TokenType::OrOr, TokenType::Pipe); break;
+        }
+        out.push_back({t, lx, l, col});
     }
-
-    if (lexer.peek() == '\'') lexer.get(); // consume closing '
-    else return {TokenType::Unknown, value, startLine, startCol}; // unterminated
-
-    return {TokenType::String, value, startLine, startCol};
+    out.push_back(makeToken(TokenType::EndOfFile, ""));
+    return out;
 }
-
-} // namespace LexerFixes
@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Scheduler mutation log: fixed-size per-thread rings of POD events, a
+// binary dump of them, and the text timeline (shared with the offline
+// viewer in Timeline.cpp).
+
+enum class MutationType : uint8_t { Scheduled, Executed, Rescheduled, Cancelled, Failed };
+
+inline const char* mutationName(MutationType t) {
+    switch (t) {
+    case MutationType::Scheduled:   return "scheduled";
+    case MutationType::Executed:    return "executed";
+    case MutationType::Rescheduled: return "rescheduled";
+    case MutationType::Cancelled:   return "cancelled";
+    case MutationType::Failed:      return "failed";
+    }
+    return "?";
+}
+
+struct MutationEvent {
+    uint64_t taskId;
+    int64_t at_ms;
+    uint32_t thread;                        // ring of the logging thread
+    MutationType type;
+    uint8_t pad[3];
+};
+static_assert(sizeof(MutationEvent) == 24, "MutationEvent is written to dumps as-is");
+
+// Dump layout: header, then `count` MutationEvents sorted by time.
+struct MutationDumpHeader {
+    char magic[8];                          // "CMJMLOG"
+    uint32_t version;
+    uint32_t eventSize;
+    uint64_t count;
+    uint64_t dropped;
+};
+
+constexpr char MUTATION_MAGIC[8] = "CMJMLOG";
+constexpr uint32_t MUTATION_VERSION = 1;
+
+// Overwrite keeps the newest events of each thread, Drop keeps the oldest.
+enum class LogPolicy : uint8_t { Overwrite, Drop };
+
+class MutationLog {
+public:
+    explicit MutationLog(size_t perThread = 4096, LogPolicy policy = LogPolicy::Overwrite)
+        : _capacity(roundUp(perThread)), _policy(policy), _id(nextLogId()) {}
+
+    MutationLog(const MutationLog&) = delete;
+    MutationLog& operator=(const MutationLog&) = delete;
+
+    // Wait-free once the calling thread has its ring (first call takes a lock).
+    void record(MutationType type, uint64_t taskId, int64_t at_ms) {
+        Ring& r = ring();
+        uint64_t h = r.head.load(std::memory_order_relaxed);
+        if (h >= _capacity) {
+            r.lost.store(r.lost.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (_policy == LogPolicy::Drop) return;
+        }
+        // Announce the slot before overwriting it so snapshot() can tell
+        // which entries it may have read half-written.
+        r.claim.store(h + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        auto* w = &r.words[(h & (_capacity - 1)) * 3];
+        w[0].store(taskId, std::memory_order_relaxed);
+        w[1].store(static_cast<uint64_t>(at_ms), std::memory_order_relaxed);
+        w[2].store(uint64_t(r.index) | uint64_t(type) << 32, std::memory_order_relaxed);
+        r.head.store(h + 1, std::memory_order_release);
+    }
+
+    // Every retained event, merged across threads by time. Does not block writers.
+    std::vector<MutationEvent> snapshot() const {
+        std::vector<MutationEvent> out;
+        std::lock_guard<std::mutex> lock(_ringsMtx);
+        for (auto& entry : _rings) {
+            const Ring& r = *entry.second;
+            uint64_t head = r.head.load(std::memory_order_acquire);
+            uint64_t first = head > _capacity ? head - _capacity : 0;   // Drop never passes _capacity
+            size_t base = out.size();
+            for (uint64_t i = first; i < head; ++i) {
+                auto* w = &r.words[(i & (_capacity - 1)) * 3];
+                MutationEvent e{};
+                e.taskId = w[0].load(std::memory_order_relaxed);
+                e.at_ms = static_cast<int64_t>(w[1].load(std::memory_order_relaxed));
+                uint64_t w2 = w[2].load(std::memory_order_relaxed);
+                e.thread = static_cast<uint32_t>(w2);
+                e.type = static_cast<MutationType>(w2 >> 32);
+                out.push_back(e);
+            }
+            // Drop entries the writer may have been overwriting meanwhile.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t claimed = r.claim.load(std::memory_order_relaxed);
+            if (claimed > _capacity && claimed - _capacity > first) {
+                size_t stale = static_cast<size_t>(std::min<uint64_t>(claimed - _capacity - first, out.size() - base));
+                out.erase(out.begin() + base, out.begin() + base + stale);
+            }
+        }
+        std::stable_sort(out.begin(), out.end(), [](const MutationEvent& a, const MutationEvent& b) {
+            return a.at_ms < b.at_ms;
+        });
+        return out;
+    }
+
+    // Events lost to overwrite or drop since construction.
+    uint64_t dropped() const {
+        std::lock_guard<std::mutex> lock(_ringsMtx);
+        uint64_t n = 0;
+        for (auto& entry : _rings) n += entry.second->lost.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    bool dump(const std::string& path) const {
+        auto events = snapshot();
+        MutationDumpHeader h{};
+        std::memcpy(h.magic, MUTATION_MAGIC, sizeof h.magic);
+        h.version = MUTATION_VERSION;
+        h.eventSize = sizeof(MutationEvent);
+        h.count = events.size();
+        h.dropped = dropped();
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        out.write(reinterpret_cast<const char*>(events.data()), std::streamsize(events.size() * sizeof(MutationEvent)));
+        return bool(out);
+    }
+
+    static bool load(const std::string& path, std::vector<MutationEvent>& events, uint64_t& dropped) {
+        std::ifstream in(path, std::ios::binary);
+        MutationDumpHeader h{};
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof h)) return false;
+        if (std::memcmp(h.magic, MUTATION_MAGIC, sizeof h.magic) != 0 || h.version != MUTATION_VERSION
+            || h.eventSize != sizeof(MutationEvent))
+            return false;
+        in.seekg(0, std::ios::end);
+        auto size = static_cast<uint64_t>(in.tellg());
+        if (size < sizeof h || (size - sizeof h) / sizeof(MutationEvent) < h.count) return false;
+        in.seekg(sizeof h);
+        events.resize(static_cast<size_t>(h.count));
+        in.read(reinterpret_cast<char*>(events.data()), std::streamsize(events.size() * sizeof(MutationEvent)));
+        dropped = h.dropped;
+        return bool(in);
+    }
+
+private:
+    struct Ring {
+        Ring(size_t cap, uint32_t index) : words(new std::atomic<uint64_t>[cap * 3]), index(index) {}
+        std::unique_ptr<std::atomic<uint64_t>[]> words;
+        uint32_t index;
+        std::atomic<uint64_t> head{ 0 };    // events written
+        std::atomic<uint64_t> claim{ 0 };   // events started
+        std::atomic<uint64_t> lost{ 0 };
+    };
+
+    size_t _capacity;
+    LogPolicy _policy;
+    uint64_t _id;                           // never reused, unlike `this`
+    mutable std::mutex _ringsMtx;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<Ring>>> _rings;
+
+    static size_t roundUp(size_t n) {
+        size_t cap = 16;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+    static uint64_t nextLogId() {
+        static std::atomic<uint64_t> ids{ 0 };
+        return ++ids;
+    }
+
+    Ring& ring() {
+        struct Cache { uint64_t log = 0; Ring* ring = nullptr; };
+        thread_local Cache cache;
+        if (cache.log == _id) return *cache.ring;
+        std::lock_guard<std::mutex> lock(_ringsMtx);
+        auto self = std::this_thread::get_id();
+        Ring* r = nullptr;
+        for (auto& entry : _rings)
+            if (entry.first == self) r = entry.second.get();
+        if (!r) {
+            _rings.emplace_back(self, std::unique_ptr<Ring>(new Ring(_capacity, static_cast<uint32_t>(_rings.size()))));
+            r = _rings.back().second.get();
+        }
+        cache = { _id, r };
+        return *r;
+    }
+};
+
+inline std::string formatTimeline(const std::vector<MutationEvent>& events) {
+    std::string sb;
+    sb.reserve(events.size() * 48);
+    for (const auto& e : events) {
+        sb += "Task " + std::to_string(e.taskId) + " " + mutationName(e.type) + " at " + std::to_string(e.at_ms) + "ms\n";
+    }
+    return sb;
+}
@@ -17,6 +17,16 @@ const Token& Parser::expect(TokenType t, const char* msg){
 
 ASTPtr Parser::parseProgram(){ return program(); }
 
+ASTPtr Parser::parseInput(){
+    auto root = AST::Node(ASTKind::Program);
+    while (!check(TokenType::EndOfFile)){
+        if (match({TokenType::KwCapsule})) root->kids.push_back(capsule());
+        else if (match({TokenType::KwFunc})) root->kids.push_back(func());
+        else root->kids.push_back(statement());
+    }
+    return root;
+}
+
 ASTPtr Parser::program(){
     auto root = AST::Node(ASTKind::Program);
     while (!check(TokenType::EndOfFile)){
@@ -30,6 +40,9 @@ ASTPtr Parser::program(){
 ASTPtr Parser::capsule(){
     auto name = expect(TokenType::Identifier, "capsule name").lexeme;
     auto cap = AST::Node(ASTKind::Capsule); cap->name = name;
+    // capsule name [from "origin"] [qualifier...]:
+    if (match({TokenType::KwFrom})) cap->literal = expect(TokenType::String, "origin string after 'from'").lexeme;
+    while (check(TokenType::Identifier)) cap->qualifiers.push_back(ts[i++].lexeme);
     expect(TokenType::Colon, "':' after capsule name");
     // capsule body as block-like sequence until 'end'
     while (!match({TokenType::KwEnd})) {
@@ -41,12 +54,14 @@ ASTPtr Parser::capsule(){
 ASTPtr Parser::func(){
     auto name = expect(TokenType::Identifier, "func name").lexeme;
     expect(TokenType::LParen, "'(' after func name");
-    // simple params: id [, id]*
+    // simple params: [type] id [, [type] id]*
     auto f = AST::Node(ASTKind::Func); f->name = name;
     if (!check(TokenType::RParen)){
         do {
             auto id = expect(TokenType::Identifier, "param name").lexeme;
-            auto p = AST::Node(ASTKind::Param); p->name = id;
+            auto p = AST::Node(ASTKind::Param);
+            if (check(TokenType::Identifier)){ p->op = id; id = ts[i++].lexeme; }
+            p->name = id;
             f->kids.push_back(p);
         } while (match({TokenType::Comma}));
     }
@@ -67,13 +82,22 @@ ASTPtr Parser::block(){
 }
 
 ASTPtr Parser::statement(){
-    if (match({TokenType::KwLet}))     return letDecl();
-    if (match({TokenType::KwReturn}))  return returnStmt();
-    if (match({TokenType::KwIf}))      return ifStmt();
-    if (match({TokenType::KwLoop}))    return loopStmt();
-    if (match({TokenType::KwSay}))     return sayStmt();
-    // assignment or expression
-    return assignOrExprStmt();
+    int line = peek().line;
+    ASTPtr n;
+    if (match({TokenType::KwLet}))          n = letDecl();
+    else if (match({TokenType::KwReturn}))  n = returnStmt();
+    else if (match({TokenType::KwIf}))      n = ifStmt();
+    else if (match({TokenType::KwLoop}))    n = loopStmt();
+    else if (match({TokenType::KwParallel})){
+        expect(TokenType::KwLoop,"'loop' after 'parallel'");
+        n = loopStmt(); n->parallel = true;
+    }
+    else if (match({TokenType::KwSay}))     n = sayStmt();
+    else if (match({TokenType::KwSchedule}))n = scheduleStmt();
+    else if (match({TokenType::KwEvery}))   n = everyStmt();
+    else n = assignOrExprStmt();            // assignment or expression
+    n->line = line;
+    return n;
 }
 
 ASTPtr Parser::letDecl(){
@@ -119,10 +143,31 @@ ASTPtr Parser::loopStmt(){
 }
 
 ASTPtr Parser::sayStmt(){
-    // say "text";
-    auto s = expect(TokenType::String,"string after 'say'").lexeme;
+    // say "text";  or  say <expr>;  (say "Hello, " + name;)
+    auto n = AST::Node(ASTKind::Say);
+    if (check(TokenType::String) && i+1<ts.size() && ts[i+1].type==TokenType::Semicolon) n->literal=ts[i++].lexeme;
+    else n->kids.push_back(expression());
     expect(TokenType::Semicolon,"';' after say");
-    auto n = AST::Node(ASTKind::Say); n->literal=s; return n;
+    return n;
+}
+
+ASTPtr Parser::scheduleStmt(){
+    // schedule tick after 500;
+    auto id = expect(TokenType::Identifier,"capsule name after 'schedule'").lexeme;
+    expect(TokenType::KwAfter,"'after'");
+    auto delay = expression();
+    expect(TokenType::Semicolon,"';' after schedule");
+    auto n = AST::Node(ASTKind::Schedule); n->name=id; n->kids.push_back(delay);
+    return n;
+}
+
+ASTPtr Parser::everyStmt(){
+    // every 1000: ... end
+    auto interval = expression();
+    auto body = block();
+    auto n = AST::Node(ASTKind::Every);
+    n->kids.push_back(interval); n->kids.push_back(body);
+    return n;
 }
 
 ASTPtr Parser::assignOrExprStmt(){
@@ -7,6 +7,7 @@ class Parser {
 public:
     explicit Parser(const std::vector<Token>& tokens);
     ASTPtr parseProgram();
+    ASTPtr parseInput();        // REPL: definitions and statements in any order
 
 private:
     const std::vector<Token> ts;
@@ -31,6 +32,8 @@ private:
     ASTPtr ifStmt();
     ASTPtr loopStmt();
     ASTPtr sayStmt();
+    ASTPtr scheduleStmt();
+    ASTPtr everyStmt();
     ASTPtr assignOrExprStmt();
 
     // expressions
@@ -0,0 +1,146 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <chrono>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Heap accounting. The counters only move if the program replaces the
+// global operator new/delete to call heapAlloc/heapFree (main.cpp does);
+// otherwise every phase reports zero bytes.
+struct HeapCounters {
+    std::atomic<std::int64_t> live{0};      // bytes currently allocated (blocks from before
+                                            // counting started may drive it below zero)
+    std::atomic<std::uint64_t> total{0};    // bytes ever allocated
+    std::atomic<std::uint64_t> allocs{0};
+    std::atomic<std::int64_t> peak{0};      // high-water mark of live
+};
+inline HeapCounters& heapCounters(){ static HeapCounters h; return h; }
+
+inline void heapAlloc(std::size_t n){
+    auto& h = heapCounters();
+    std::int64_t now = h.live.fetch_add(static_cast<std::int64_t>(n), std::memory_order_relaxed) + static_cast<std::int64_t>(n);
+    h.total.fetch_add(n, std::memory_order_relaxed);
+    h.allocs.fetch_add(1, std::memory_order_relaxed);
+    std::int64_t p = h.peak.load(std::memory_order_relaxed);
+    while (now > p && !h.peak.compare_exchange_weak(p, now, std::memory_order_relaxed)) {}
+}
+inline void heapFree(std::size_t n){ heapCounters().live.fetch_sub(static_cast<std::int64_t>(n), std::memory_order_relaxed); }
+
+// One timed phase or pass. Nested scopes have depth > 0; times and bytes
+// of a phase include its nested passes.
+struct PassRecord {
+    std::string name;
+    int depth = 0;
+    double wallMs = 0, cpuMs = 0;           // cpu: whole process, so worker threads count
+    std::uint64_t allocBytes = 0;           // cumulative bytes allocated in the phase
+    std::uint64_t allocs = 0;
+    std::uint64_t peakBytes = 0;            // highest live heap while the phase ran
+};
+
+// Collects --time-passes / --stats data. A null PassStats* turns every
+// Scope into a no-op, so passes can be instrumented unconditionally.
+struct PassStats {
+    std::vector<PassRecord> passes;         // in start order
+    std::vector<std::pair<std::string,std::uint64_t>> counts;   // tokens, AST nodes, ...
+    std::vector<std::pair<std::string,std::uint64_t>> funcSizes;// IR instructions per function
+
+    class Scope {
+    public:
+        Scope(PassStats* s, const char* name) : s(s) {
+            if (!s) return;
+            idx = s->passes.size();
+            s->passes.push_back({name, s->depth++});
+            auto& h = heapCounters();
+            total0 = h.total.load(std::memory_order_relaxed);
+            allocs0 = h.allocs.load(std::memory_order_relaxed);
+            outerPeak = h.peak.exchange(h.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            wall0 = std::chrono::steady_clock::now();
+            cpu0 = cpuNow();
+        }
+        ~Scope(){
+            if (!s) return;
+            auto& r = s->passes[idx];
+            r.cpuMs = cpuNow() - cpu0;
+            r.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall0).count();
+            auto& h = heapCounters();
+            r.allocBytes = h.total.load(std::memory_order_relaxed) - total0;
+            r.allocs = h.allocs.load(std::memory_order_relaxed) - allocs0;
+            std::int64_t p = h.peak.load(std::memory_order_relaxed);
+            r.peakBytes = static_cast<std::uint64_t>(std::max<std::int64_t>(0, p));
+            // the enclosing phase still needs to see this phase's peak
+            while (outerPeak > p && !h.peak.compare_exchange_weak(p, outerPeak, std::memory_order_relaxed)) {}
+            --s->depth;
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        PassStats* s;
+        std::size_t idx = 0;
+        std::uint64_t total0 = 0, allocs0 = 0;
+        std::int64_t outerPeak = 0;
+        std::chrono::steady_clock::time_point wall0;
+        double cpu0 = 0;
+    };
+
+    void count(const std::string& name, std::uint64_t v){ counts.emplace_back(name, v); }
+
+    static double cpuNow(){
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+    }
+
+    void printPasses(std::ostream& os) const {
+        char line[160];
+        std::snprintf(line, sizeof line, "%-28s %10s %10s %12s %12s %10s\n", "phase", "wall ms", "cpu ms", "alloc KiB", "peak KiB", "allocs");
+        os << line;
+        for (auto& r : passes){
+            std::string name = std::string(2 * r.depth, ' ') + r.name;
+            std::snprintf(line, sizeof line, "%-28s %10.3f %10.3f %12.1f %12.1f %10llu\n", name.c_str(), r.wallMs, r.cpuMs,
+                          r.allocBytes / 1024.0, r.peakBytes / 1024.0, static_cast<unsigned long long>(r.allocs));
+            os << line;
+        }
+    }
+
+    // Counts, then the largest functions first (at most `top`, 0 = all).
+    void printStats(std::ostream& os, std::size_t top = 20) const {
+        for (auto& c : counts) os << c.first << ": " << c.second << '\n';
+        auto sorted = funcSizes;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b){ return a.second > b.second; });
+        if (top && sorted.size() > top) sorted.resize(top);
+        if (!sorted.empty()) os << "IR instructions per function" << (top && funcSizes.size() > top ? " (largest " + std::to_string(top) + ")" : "") << ":\n";
+        for (auto& f : sorted) os << "  " << f.second << '\t' << f.first << '\n';
+    }
+
+    void printJSON(std::ostream& os) const {
+        auto str = [&](const std::string& s){
+            os << '"';
+            for (char c : s){
+                if (c == '"' || c == '\\') os << '\\';
+                if (static_cast<unsigned char>(c) >= 0x20) os << c;
+            }
+            os << '"';
+        };
+        os << "{\"passes\":[";
+        for (std::size_t i = 0; i < passes.size(); ++i){
+            auto& r = passes[i];
+            os << (i ? "," : "") << "{\"name\":"; str(r.name);
+            os << ",\"depth\":" << r.depth << ",\"wall_ms\":" << r.wallMs << ",\"cpu_ms\":" << r.cpuMs
+               << ",\"alloc_bytes\":" << r.allocBytes << ",\"allocs\":" << r.allocs << ",\"peak_bytes\":" << r.peakBytes << "}";
+        }
+        os << "],\"counts\":{";
+        for (std::size_t i = 0; i < counts.size(); ++i){ os << (i ? "," : ""); str(counts[i].first); os << ':' << counts[i].second; }
+        os << "},\"ir_per_function\":{";
+        for (std::size_t i = 0; i < funcSizes.size(); ++i){ os << (i ? "," : ""); str(funcSizes[i].first); os << ':' << funcSizes[i].second; }
+        os << "}}\n";
+    }
+
+private:
+    int depth = 0;
+};
@@ -0,0 +1,156 @@
+#pragma once
+// Included by main.cpp after Runner.cpp: needs VM, Lexer, Parser, IRGen.
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Interactive session (cmajor --repl). Each input is lexed, parsed and
+// lowered on its own, and nothing entered earlier is compiled again:
+//  - func and capsule definitions are hot-swapped into the live VM,
+//    replacing an earlier definition of the same name;
+//  - statements become the body of __repl, whose parameters are the
+//    session's variables. It runs at once and the parameters' final
+//    values are kept for the next input. A `let` of a new name adds a
+//    variable. A bare expression is echoed.
+// An input that fails to parse or lower changes nothing.
+class Repl {
+public:
+    Repl(VM& vm, bool autoPar) : vm(vm), autoPar(autoPar) {}
+
+    // Read inputs until EOF or :quit. A line that opens a block (`:`)
+    // continues until its `end`. A final `;` may be left off.
+    int run(std::istream& in, std::ostream& out, bool interactive) {
+        std::string buf;
+        int depth = 0, status = 0;
+        for (std::string line;;) {
+            if (interactive) out << (buf.empty() ? "cmajor> " : "   ...> ") << std::flush;
+            if (!std::getline(in, line)) break;
+            if (buf.empty() && !line.empty() && line[0] == ':') {
+                if (!command(line, out)) break;
+                continue;
+            }
+            buf += line;
+            buf += '\n';
+            std::vector<Token> toks;
+            try { Lexer lx(buf); toks = lx.tokenize(); }
+            catch (const std::exception& e) { std::cerr << "error: " << e.what() << "\n"; buf.clear(); status = 1; continue; }
+            depth = 0;
+            TokenType last = TokenType::EndOfFile;
+            for (auto& t : toks) {
+                if (t.type == TokenType::Colon) ++depth;
+                if (t.type == TokenType::KwEnd) --depth;
+                if (t.type != TokenType::EndOfFile) last = t.type;
+            }
+            if (depth > 0) continue;
+            if (last != TokenType::EndOfFile && last != TokenType::Semicolon && last != TokenType::KwEnd) buf += ";";
+            if (last != TokenType::EndOfFile && !eval(buf)) status = 1;
+            buf.clear();
+        }
+        if (!buf.empty() && !eval(buf)) status = 1;
+        OutputSink::instance().flush();
+        return status;
+    }
+
+    // One complete input; false if it did not compile or failed at runtime.
+    bool eval(const std::string& src) {
+        ASTPtr prog = AST::Node(ASTKind::Program);
+        ASTPtr body = AST::Node(ASTKind::Block);
+        std::vector<std::string> fresh;
+        bool timers = false;
+        IRModule mod;
+        try {
+            Lexer lx(src);
+            auto toks = lx.tokenize();
+            Parser ps(toks);
+            ASTPtr input = ps.parseInput();
+            for (auto& n : input->kids) {
+                if (n->kind == ASTKind::Func || n->kind == ASTKind::Capsule) { prog->kids.push_back(n); continue; }
+                if (isExpr(n->kind)) {   // echo
+                    auto say = AST::Node(ASTKind::Say);
+                    say->line = n->line;
+                    say->kids.push_back(n);
+                    n = say;
+                }
+                body->kids.push_back(n);
+                scan(n, fresh, timers);
+            }
+            if (!body->kids.empty()) {
+                // an `every` body is a function of its own that outlives
+                // this input, so it needs a name the next input won't reuse
+                auto fn = AST::Node(ASTKind::Func);
+                fn->name = timers ? "__repl" + std::to_string(inputs) : "__repl";
+                for (std::size_t k = 0; k < names.size(); ++k) fn->kids.push_back(param(names[k], values[k].isVec()));
+                for (auto& v : fresh) fn->kids.push_back(param(v, false));
+                fn->kids.push_back(body);
+                prog->kids.push_back(fn);
+                entry = fn->name;
+            }
+            IRGen gen;
+            gen.autoParallel = autoPar;
+            mod = gen.generate(prog);
+        } catch (const std::exception& e) {
+            std::cerr << "error: " << e.what() << "\n";
+            return false;
+        }
+        ++inputs;
+        // generate() adds a wrapper that calls main when none was defined
+        mod.funcs.erase(std::remove_if(mod.funcs.begin(), mod.funcs.end(),
+                                       [](const IRFunction& f) { return f.name == "__entry"; }), mod.funcs.end());
+        vm.swap(mod);
+        if (body->kids.empty()) return true;
+        names.insert(names.end(), fresh.begin(), fresh.end());
+        values.resize(names.size());
+        bool ok = vm.callWith(entry, values);
+        OutputSink::instance().flush();
+        return ok;
+    }
+
+private:
+    VM& vm;
+    bool autoPar;
+    std::vector<std::string> names;     // session variables, in order of their first `let`
+    std::vector<Value> values;
+    std::size_t inputs = 0;
+    std::string entry;
+
+    static bool isExpr(ASTKind k) {
+        return k == ASTKind::Binary || k == ASTKind::Unary || k == ASTKind::Call || k == ASTKind::Var || k == ASTKind::Literal;
+    }
+
+    // A variable holding a vector is declared one, so the input is
+    // checked and lowered as if it had been written in one function.
+    static ASTPtr param(const std::string& name, bool vector) {
+        auto p = AST::Node(ASTKind::Param);
+        p->name = name;
+        if (vector) p->op = "vector";
+        return p;
+    }
+
+    // New `let` names, outside every bodies (those are the body's own).
+    void scan(const ASTPtr& n, std::vector<std::string>& fresh, bool& timers) const {
+        if (!n) return;
+        if (n->kind == ASTKind::Every) { timers = true; return; }
+        if (n->kind == ASTKind::Let && std::find(names.begin(), names.end(), n->name) == names.end()
+            && std::find(fresh.begin(), fresh.end(), n->name) == fresh.end())
+            fresh.push_back(n->name);
+        for (auto& k : n->kids) scan(k, fresh, timers);
+    }
+
+    // :vars, :save FILE, :help; false for :quit.
+    bool command(const std::string& line, std::ostream& out) {
+        std::string cmd = line.substr(0, line.find(' '));
+        std::string arg = cmd.size() < line.size() ? line.substr(cmd.size() + 1) : "";
+        if (cmd == ":quit" || cmd == ":q") return false;
+        if (cmd == ":vars") {
+            for (std::size_t k = 0; k < names.size(); ++k) out << names[k] << " = " << VM::text(values[k]) << "\n";
+        } else if (cmd == ":save" && !arg.empty()) {
+            if (!vm.saveCapsule(arg)) std::cerr << "Cannot write capsule " << arg << "\n";
+        } else {
+            out << ":vars              list session variables\n"
+                << ":save FILE         write every definition as a .cmajcapsule\n"
+                << ":quit              leave (EOF works too)\n";
+        }
+        return true;
+    }
+};
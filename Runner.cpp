@@ -2,43 +2,1053 @@
 // Self-contained, PURE C++ VM based on your snippet (no external headers).
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <csignal>
+#include "IR.hpp"
+#include "Scheduler.cpp"  // timing wheel behind schedule / every
+#include "Trace.hpp"
+#include "Simd.hpp"
+
+static const char* irOpName(IROp op) {
+    switch (op) {
+    case IROp::ICONST: return "ICONST"; case IROp::FCONST: return "FCONST";
+    case IROp::SCONST: return "SCONST";
+    case IROp::LOAD:   return "LOAD";   case IROp::STORE:  return "STORE";
+    case IROp::ADD:    return "ADD";    case IROp::SUB:    return "SUB";
+    case IROp::MUL:    return "MUL";    case IROp::DIV:    return "DIV";
+    case IROp::MOD:    return "MOD";
+    case IROp::CMP_EQ: return "CMP_EQ"; case IROp::CMP_NE: return "CMP_NE";
+    case IROp::CMP_LT: return "CMP_LT"; case IROp::CMP_LE: return "CMP_LE";
+    case IROp::CMP_GT: return "CMP_GT"; case IROp::CMP_GE: return "CMP_GE";
+    case IROp::AND:    return "AND";    case IROp::OR:     return "OR";
+    case IROp::NOT:    return "NOT";    case IROp::PRINT:  return "PRINT";
+    case IROp::CALL:   return "CALL";   case IROp::JMP:    return "JMP";
+    case IROp::JZ:     return "JZ";     case IROp::LABEL:  return "LABEL";
+    case IROp::RET:    return "RET";    case IROp::PARFOR: return "PARFOR";
+    case IROp::SCHEDULE: return "SCHEDULE"; case IROp::EVERY: return "EVERY";
+    case IROp::VEC:    return "VEC";    case IROp::VADD:   return "VADD";
+    case IROp::VMUL:   return "VMUL";   case IROp::VMIN:   return "VMIN";
+    case IROp::VMAX:   return "VMAX";   case IROp::VDOT:   return "VDOT";
+    case IROp::VCLAMP: return "VCLAMP";
+    default:           return "?";
+    }
+}
 
 // -----------------------------
-// Minimal IR surface (inline):
+// Superinstructions:
 // -----------------------------
-enum class IROp {
-    ICONST,   // a <- int(b)
-    SCONST,   // a <- string(b)
-    LOAD,     // a <- b
-    STORE,    // a <- b (alias kept for clarity)
+// The loader rewrites each IRFunction into a decoded stream. Labels are
+// resolved to decoded pcs and dropped, ICONST immediates are parsed once,
+// and frequent IR n-grams are fused into a single dispatch.
+enum class VOp : std::uint8_t {
+    ICONST, FCONST, SCONST, LOAD, STORE,
     ADD, SUB, MUL, DIV,
     CMP_EQ, CMP_LE, CMP_LT, CMP_GT, CMP_GE,
-    PRINT,    // print a (int or string)
-    CALL,     // call a(); if b != "", store return in b
-    JMP,      // goto label a
-    JZ,       // if !a goto b
-    LABEL,    // define label a
-    RET       // return a (optional)
+    PRINT, PRINT_STR, CALL, TAILCALL, JMP, JZ, RET, PARFOR, SCHEDULE, EVERY,
+    VEC, VADD, VMUL, VMIN, VMAX, VDOT, VCLAMP,
+    // fused
+    LOOP_TEST,      // LOAD; CMP_LE; JZ          (loop header)
+    ADD_IMM_STORE,  // ICONST; ADD; STORE        (i = i + 1)
+    TEST_EQ_IMM,    // LOAD; ICONST; CMP_EQ; JZ  (if (x == k))
+    CONST_STORE,    // ICONST; STORE             (let x = k)
+    LOAD_LOAD_ADD   // LOAD; LOAD; ADD           (a + b)
+};
+constexpr unsigned VOP_COUNT = static_cast<unsigned>(VOp::LOAD_LOAD_ADD) + 1;
+
+static const char* vopName(VOp op) {
+    static const char* const names[VOP_COUNT] = {
+        "ICONST", "FCONST", "SCONST", "LOAD", "STORE",
+        "ADD", "SUB", "MUL", "DIV",
+        "CMP_EQ", "CMP_LE", "CMP_LT", "CMP_GT", "CMP_GE",
+        "PRINT", "PRINT_STR", "CALL", "TAILCALL", "JMP", "JZ", "RET", "PARFOR", "SCHEDULE", "EVERY",
+        "VEC", "VADD", "VMUL", "VMIN", "VMAX", "VDOT", "VCLAMP",
+        "LOOP_TEST", "ADD_IMM_STORE", "TEST_EQ_IMM", "CONST_STORE", "LOAD_LOAD_ADD",
+    };
+    return static_cast<unsigned>(op) < VOP_COUNT ? names[static_cast<unsigned>(op)] : "?";
+}
+
+struct SuperopPattern {
+    VOp fused;
+    const char* name;
+    std::vector<IROp> seq;
+    std::uint64_t staticCount = 0;   // occurrences in the loaded module
+    std::uint64_t profileCount = 0;  // dynamic count from a profile file
+    std::uint64_t fusedSites = 0;    // sites actually rewritten
+
+    // Dispatches saved if every occurrence were fused.
+    std::uint64_t score() const { return (staticCount + profileCount) * (seq.size() - 1); }
+};
+
+class SuperopTable {
+public:
+    static SuperopTable defaults() {
+        SuperopTable t;
+        t.patterns = {
+            { VOp::LOOP_TEST,     "LOOP_TEST",     { IROp::LOAD, IROp::CMP_LE, IROp::JZ } },
+            { VOp::ADD_IMM_STORE, "ADD_IMM_STORE", { IROp::ICONST, IROp::ADD, IROp::STORE } },
+            { VOp::TEST_EQ_IMM,   "TEST_EQ_IMM",   { IROp::LOAD, IROp::ICONST, IROp::CMP_EQ, IROp::JZ } },
+            { VOp::CONST_STORE,   "CONST_STORE",   { IROp::ICONST, IROp::STORE } },
+            { VOp::LOAD_LOAD_ADD, "LOAD_LOAD_ADD", { IROp::LOAD, IROp::LOAD, IROp::ADD } },
+        };
+        return t;
+    }
+
+    // Profile lines: "<count> <OP> <OP> ..." (e.g. "120000 LOAD CMP_LE JZ").
+    // Counts for sequences that match a static pattern raise its priority.
+    bool loadProfile(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) return false;
+        std::string line;
+        while (std::getline(in, line)) {
+            std::istringstream ls(line);
+            std::uint64_t count = 0;
+            if (!(ls >> count)) continue;
+            std::vector<std::string> ops;
+            for (std::string op; ls >> op;) ops.push_back(op);
+            for (auto& p : patterns) {
+                if (p.seq.size() != ops.size()) continue;
+                bool same = true;
+                for (std::size_t k = 0; k < ops.size(); ++k)
+                    if (ops[k] != irOpName(p.seq[k])) { same = false; break; }
+                if (same) p.profileCount += count;
+            }
+        }
+        return true;
+    }
+
+    std::vector<SuperopPattern> patterns;
+    bool enabled = true;
+};
+
+static constexpr std::uint32_t NO_SLOT = UINT32_MAX;
+static constexpr std::uint32_t NO_FUNC = UINT32_MAX;
+
+struct RopeNode;
+
+// One VM register, NaN-boxed into 8 bytes. A double is stored as its own
+// bits; every other value is a negative quiet NaN whose bits 48-50 hold a
+// nonzero tag and whose low 48 bits hold the payload:
+//   INT    int32           BOOL   0 / 1            STR   const std::string*
+//   SMALL  up to 5 bytes of text, length in bits 40-47    ROPE  RopeNode*
+//   VEC    const VecNode*  (a `vector`, see Simd.hpp)
+// Tag 0 is the hardware's default NaN, so real NaNs can never be mistaken
+// for a boxed value; other NaN payloads are canonicalized when boxed.
+// A default Value is the int 0.
+class Value {
+public:
+    static constexpr std::size_t SMALL_MAX = 5;
+
+    Value() = default;
+
+    static Value fromInt(int v) { return Value(box(INT, static_cast<std::uint32_t>(v))); }
+    static Value fromBool(bool v) { return Value(box(BOOL, v ? 1 : 0)); }
+    static Value fromStr(const std::string* p) {
+        return Value(box(STR, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p))));
+    }
+    static Value fromSmall(const char* p, std::size_t n) {
+        std::uint64_t payload = static_cast<std::uint64_t>(n) << 40;
+        for (std::size_t k = 0; k < n; ++k)
+            payload |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[k])) << (8 * k);
+        return Value(box(SMALL, payload));
+    }
+    static Value fromRope(const RopeNode* p) {
+        return Value(box(ROPE, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p))));
+    }
+    static Value fromVec(const VecNode* p) {
+        return Value(box(VEC, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p))));
+    }
+    static Value fromDouble(double d) {
+        std::uint64_t b;
+        std::memcpy(&b, &d, sizeof b);
+        if ((b & BOXED) == BOXED && (b & TAG_BITS) != 0) b = CANON_NAN;
+        return Value(b);
+    }
+
+    bool isInt() const { return (bits & TAG_MASK) == tagBits(INT); }
+    bool isBool() const { return (bits & TAG_MASK) == tagBits(BOOL); }
+    bool isStr() const { return (bits & TAG_MASK) == tagBits(STR); }
+    bool isSmall() const { return (bits & TAG_MASK) == tagBits(SMALL); }
+    bool isRope() const { return (bits & TAG_MASK) == tagBits(ROPE); }
+    bool isText() const { return isStr() || isSmall() || isRope(); }
+    bool isVec() const { return (bits & TAG_MASK) == tagBits(VEC); }
+    bool isDouble() const { return (bits & BOXED) != BOXED || (bits & TAG_BITS) == 0; }
+
+    int asInt() const { return static_cast<int>(static_cast<std::uint32_t>(bits)); }
+    bool asBool() const { return (bits & 1) != 0; }
+    const std::string* asStr() const {
+        return reinterpret_cast<const std::string*>(static_cast<std::uintptr_t>(bits & PAYLOAD));
+    }
+    std::size_t smallSize() const { return static_cast<std::size_t>(bits >> 40) & 0xFF; }
+    char smallAt(std::size_t k) const { return static_cast<char>(bits >> (8 * k)); }
+    const RopeNode* asRope() const {
+        return reinterpret_cast<const RopeNode*>(static_cast<std::uintptr_t>(bits & PAYLOAD));
+    }
+    const VecNode* asVec() const {
+        return reinterpret_cast<const VecNode*>(static_cast<std::uintptr_t>(bits & PAYLOAD));
+    }
+    double asDouble() const {
+        double d;
+        std::memcpy(&d, &bits, sizeof d);
+        return d;
+    }
+
+    // Numeric views: text and vectors read as 0, bools as 0 / 1.
+    int toInt() const {
+        if (isInt() || isBool()) return asInt();
+        if (isDouble()) return static_cast<int>(asDouble());
+        return 0;
+    }
+    double toDouble() const { return isDouble() ? asDouble() : static_cast<double>(toInt()); }
+    bool truthy() const;    // nonzero number, non-empty text or a nonzero lane
+
+    std::uint64_t raw() const { return bits; }
+
+private:
+    enum Tag : std::uint64_t { INT = 1, BOOL = 2, STR = 3, SMALL = 4, ROPE = 5, VEC = 6 };
+    static constexpr std::uint64_t BOXED = 0xFFF8000000000000ull;     // sign, exponent, quiet bit
+    static constexpr std::uint64_t TAG_BITS = 0x0007000000000000ull;
+    static constexpr std::uint64_t TAG_MASK = BOXED | TAG_BITS;
+    static constexpr std::uint64_t PAYLOAD = 0x0000FFFFFFFFFFFFull;
+    static constexpr std::uint64_t CANON_NAN = 0x7FF8000000000000ull;
+    static constexpr std::uint64_t tagBits(Tag t) { return BOXED | t << 48; }
+    static constexpr std::uint64_t box(Tag t, std::uint64_t payload) { return tagBits(t) | (payload & PAYLOAD); }
+
+    explicit Value(std::uint64_t b) : bits(b) {}
+    std::uint64_t bits = tagBits(INT);
+};
+static_assert(sizeof(Value) == 8, "Value must stay one 8-byte word");
+
+// -----------------------------
+// Strings:
+// -----------------------------
+// STR text is an immutable std::string: a module constant from the VM's
+// interner, or one made at runtime in a context's StringArena. `+` on text
+// allocates one RopeNode (O(1) append); text is flattened only when it is
+// printed or compared.
+
+struct RopeNode {
+    Value left, right;
+    std::size_t size;
+};
+
+// Rope nodes, runtime strings and vectors of one ExecContext. Entries are
+// never modified; the one exception is a vector held by a scratch temp or
+// an owned name (VM::markScratch) while no checkpoint holds the arena. Once the arena reaches collectAt
+// entries, the next back-edge or call copies what the stack still reaches
+// into a fresh arena (VM::collectText) and drops the rest.
+struct StringArena {
+    static constexpr std::size_t COLLECT_MIN = 1 << 14;
+    std::deque<RopeNode> nodes;
+    std::deque<std::string> texts;
+    std::deque<VecNode> vecs;
+    std::size_t collectAt = COLLECT_MIN;
+    std::size_t size() const { return nodes.size() + texts.size() + vecs.size(); }
 };
 
-struct IRInstr {
-    IROp op{};
-    std::string a, b, c; // simple 3-operand string fields for this toy IR
+static std::size_t textSize(Value v) {
+    if (v.isStr()) return v.asStr()->size();
+    if (v.isSmall()) return v.smallSize();
+    if (v.isRope()) return v.asRope()->size;
+    return 0;
+}
+
+// Append the text of v to out, walking ropes left to right without recursion.
+static void appendText(std::string& out, Value v) {
+    if (v.isStr()) { out += *v.asStr(); return; }
+    if (v.isSmall()) { for (std::size_t k = 0; k < v.smallSize(); ++k) out += v.smallAt(k); return; }
+    std::vector<Value> todo{ v };
+    while (!todo.empty()) {
+        Value x = todo.back();
+        todo.pop_back();
+        if (x.isRope()) {
+            todo.push_back(x.asRope()->right);
+            todo.push_back(x.asRope()->left);
+        } else {
+            appendText(out, x);
+        }
+    }
+}
+
+inline bool Value::truthy() const {
+    if (isDouble()) return asDouble() != 0.0;
+    if (isText()) return textSize(*this) != 0;
+    if (isVec()) {
+        for (std::uint32_t k = 0; k < asVec()->width; ++k) if (asVec()->lane[k] != 0.0f) return true;
+        return false;
+    }
+    return asInt() != 0;
+}
+
+// Operands of one IR instruction after name -> slot resolution.
+struct Operand3 {
+    std::uint32_t a = NO_SLOT, b = NO_SLOT, c = NO_SLOT;
 };
 
-struct IRFunction {
-    std::string name;
-    std::vector<std::string> params;
-    std::vector<IRInstr> code;
+struct DInstr {
+    VOp op{};
+    std::uint32_t a = 0, b = 0, c = 0; // slots / pool indices of the first IR instruction
+    std::uint32_t src = 0;      // first IR instruction covered
+    std::uint32_t target = 0;   // resolved jump target (decoded pc)
+    int imm = 0;                // parsed ICONST immediate / CALL argc
 };
 
-struct IRModule {
-    std::vector<IRFunction> funcs;
+struct LoadedFunc {
+    const IRFunction* ir = nullptr;
+    std::unique_ptr<IRFunction> own;    // IR copy for hot-swapped versions
+    std::uint32_t index = 0;            // stable position in FuncTable::funcs
+    std::vector<DInstr> code;
+    std::vector<Operand3> ops;          // parallel to ir->code, read by fused handlers
+    std::vector<const std::string*> strings;   // SCONST / literal PRINT pool (interned)
+    std::vector<Value> consts;          // FCONST pool
+    std::vector<std::uint32_t> args;    // CALL / PARFOR argument slots (DInstr::c = first, imm = count)
+    std::uint32_t nslots = 0;           // params occupy slots [0, params.size())
+    std::vector<char> scratch;          // per slot: a vector temp reused in place, see markScratch
+    std::vector<char> owned;            // per slot: a name STORE copies vectors into, see markScratch
+    std::atomic<bool> ready{ true };    // false until a capsule function is materialized
+};
+
+// -----------------------------
+// Output:
+// -----------------------------
+// PRINT appends whole lines to a per-thread buffer. Full buffers are handed
+// to a background writer, which drains everything queued with one writev.
+// A thread's lines keep program order and lines never interleave; fibers
+// hand their buffer over at every yield, so they keep order across workers.
+enum class FlushPolicy {
+    Line,       // hand over after every line
+    Size,       // hand over once the buffer reaches sizeLimit bytes
+    Interval,   // Size, plus the writer collects all buffers every intervalMs
+    Exit        // only on flush() / thread exit (capped at 64 * sizeLimit)
+};
+
+class OutputSink {
+public:
+    static OutputSink& instance() {
+        static OutputSink sink;
+        return sink;
+    }
+
+    void configure(FlushPolicy p, std::size_t size, int intervalMillis, bool direct) {
+        flush();
+        std::lock_guard<std::mutex> lock(mtx);
+        policy = p;
+        sizeLimit = size ? size : 1;
+        intervalMs = intervalMillis > 0 ? intervalMillis : 1;
+        unbuffered = direct;
+        cv.notify_all();
+    }
+
+    void write(const std::string& text) {
+        if (unbuffered) {
+            std::lock_guard<std::mutex> lock(directMtx);
+            writeAll(text.data(), text.size());
+            return;
+        }
+        ThreadBuffer& tb = local();
+        std::lock_guard<std::mutex> lock(tb.m);
+        tb.data += text;
+        if (policy == FlushPolicy::Line
+            || (policy != FlushPolicy::Exit && tb.data.size() >= sizeLimit)
+            || tb.data.size() >= sizeLimit * 64)
+            submit(tb.data);
+    }
+
+    // Hand this thread's buffer to the writer (fiber yield points).
+    void flushThread() {
+        if (unbuffered) return;
+        ThreadBuffer& tb = local();
+        std::lock_guard<std::mutex> lock(tb.m);
+        submit(tb.data);
+    }
+
+    // Hand over every thread's buffer and wait until it has been written.
+    void flush() {
+        collectAll();
+        std::unique_lock<std::mutex> lock(mtx);
+        std::uint64_t target = submitted;
+        cv.notify_all();
+        drained.wait(lock, [&] { return written >= target; });
+    }
+
+    ~OutputSink() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        writer.join();
+    }
+
+private:
+    struct ThreadBuffer {
+        std::mutex m;
+        std::string data;
+    };
+
+    // Registers the calling thread's buffer; its destructor hands over leftovers.
+    struct LocalHandle {
+        OutputSink& sink;
+        ThreadBuffer tb;
+        explicit LocalHandle(OutputSink& s) : sink(s) {
+            std::lock_guard<std::mutex> lock(sink.mtx);
+            sink.buffers.push_back(&tb);
+        }
+        ~LocalHandle() {
+            {
+                std::lock_guard<std::mutex> lock(tb.m);
+                sink.submit(tb.data);
+            }
+            std::lock_guard<std::mutex> lock(sink.mtx);
+            sink.buffers.erase(std::find(sink.buffers.begin(), sink.buffers.end(), &tb));
+        }
+    };
+
+    FlushPolicy policy = FlushPolicy::Line;
+    std::size_t sizeLimit = 64 * 1024;
+    int intervalMs = 50;
+    std::atomic<bool> unbuffered{ false };
+
+    std::mutex mtx, directMtx;
+    std::condition_variable cv, drained;
+    std::vector<std::string> queue;
+    std::vector<ThreadBuffer*> buffers;
+    std::uint64_t submitted = 0, written = 0;
+    bool stopping = false;
+    std::thread writer{ [this] { run(); } };
+
+    ThreadBuffer& local() {
+        static thread_local LocalHandle handle(*this);
+        return handle.tb;
+    }
+
+    // Caller holds the buffer's lock.
+    void submit(std::string& data) {
+        if (data.empty()) return;
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(std::move(data));
+        data.clear();
+        ++submitted;
+        if (policy != FlushPolicy::Interval) cv.notify_one();
+    }
+
+    void collectAll() {
+        std::vector<ThreadBuffer*> all;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            all = buffers;
+        }
+        for (ThreadBuffer* tb : all) {
+            std::lock_guard<std::mutex> lock(tb->m);
+            submit(tb->data);
+        }
+    }
+
+    static void writeAll(const char* p, std::size_t n) {
+        while (n > 0) {
+            ssize_t w = ::write(STDOUT_FILENO, p, n);
+            if (w <= 0) return;
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+    }
+
+    void writeBatch(std::vector<std::string>& batch) {
+        std::vector<iovec> iov;
+        for (auto& chunk : batch) iov.push_back({ const_cast<char*>(chunk.data()), chunk.size() });
+        std::size_t at = 0;
+        while (at < iov.size()) {
+            int n = static_cast<int>(std::min<std::size_t>(iov.size() - at, IOV_MAX));
+            ssize_t w = ::writev(STDOUT_FILENO, iov.data() + at, n);
+            if (w <= 0) return;
+            // Skip fully written chunks; finish a partial one with write().
+            std::size_t left = static_cast<std::size_t>(w);
+            while (at < iov.size() && left >= iov[at].iov_len) left -= iov[at++].iov_len;
+            if (left > 0) {
+                writeAll(static_cast<char*>(iov[at].iov_base) + left, iov[at].iov_len - left);
+                ++at;
+            }
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;) {
+            if (policy == FlushPolicy::Interval) {
+                cv.wait_for(lock, std::chrono::milliseconds(intervalMs));
+                if (!stopping) {
+                    lock.unlock();
+                    collectAll();
+                    lock.lock();
+                }
+            } else {
+                cv.wait(lock, [this] { return stopping || !queue.empty(); });
+            }
+            if (queue.empty()) {
+                drained.notify_all();
+                if (stopping) return;
+                continue;
+            }
+            std::vector<std::string> batch;
+            batch.swap(queue);
+            lock.unlock();
+            writeBatch(batch);
+            lock.lock();
+            written += batch.size();
+            drained.notify_all();
+        }
+    }
+};
+
+// While set, PRINT output on this thread is buffered (parallel loop chunks).
+static std::string*& outputCapture() {
+    static thread_local std::string* capture = nullptr;
+    return capture;
+}
+
+static void emitText(const std::string& text) {
+    if (std::string* capture = outputCapture()) {
+        *capture += text;
+        return;
+    }
+    OutputSink::instance().write(text);
+}
+
+// Work-stealing pool for parallel loop chunks. The thread calling
+// parallelFor() helps run tasks until its own batch is done, so nested
+// parallel loops cannot deadlock the pool.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t workers) : queues(workers ? workers : 1) {
+        for (std::size_t w = 0; w < queues.size(); ++w)
+            threads.emplace_back([this, w] { work(w); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    std::size_t size() const { return queues.size(); }
+
+    void parallelFor(std::size_t n, const std::function<void(std::size_t)>& fn) {
+        std::atomic<std::size_t> remaining{ n };
+        for (std::size_t k = 0; k < n; ++k)
+            push(k % queues.size(), [&fn, &remaining, k] { fn(k); remaining.fetch_sub(1); });
+        while (remaining.load() > 0) {
+            std::function<void()> task;
+            if (steal(0, task)) task();
+            else std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::function<void()>> q;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<std::size_t> queued{ 0 };
+    bool stopping = false;
+
+    void push(std::size_t w, std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[w].m);
+            queues[w].q.push_back(std::move(task));
+        }
+        if (queued.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_all();
+        }
+    }
+
+    // Own queue from the back (LIFO, cache-warm), others from the front.
+    bool steal(std::size_t w, std::function<void()>& out) {
+        for (std::size_t k = 0; k < queues.size(); ++k) {
+            Queue& q = queues[(w + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.m);
+            if (q.q.empty()) continue;
+            if (k == 0) { out = std::move(q.q.back()); q.q.pop_back(); }
+            else { out = std::move(q.q.front()); q.q.pop_front(); }
+            queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void work(std::size_t w) {
+        for (;;) {
+            std::function<void()> task;
+            if (steal(w, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+};
+
+struct Frame {
+    const LoadedFunc* fn = nullptr;
+    std::uint32_t pc = 0;
+    std::uint32_t base = 0;     // first slot in ExecContext::stack
+    std::uint32_t ret = NO_SLOT; // absolute caller slot receiving the result
+    std::uint32_t epoch = 0;    // FuncTable epoch `fn` was looked up in
+};
+
+// -----------------------------
+// Checkpoints:
+// -----------------------------
+
+constexpr std::uint32_t CHECKPOINT_PAGE = 64;   // slots per copy-on-write page
+
+struct CheckpointPage {
+    Value slots[CHECKPOINT_PAGE];
+};
+using PageRef = std::shared_ptr<const CheckpointPage>;
+
+// What a context read from outside the VM: its entry point and arguments.
+// Execution is otherwise a function of the code, so replaying the log
+// reproduces the run.
+struct InputLog {
+    std::uint32_t entry = NO_FUNC;
+    std::vector<Value> args;
+};
+
+// Persistent snapshot of an ExecContext. Pages not written since the
+// previous checkpoint of the same context are shared, not copied.
+struct Checkpoint {
+    std::vector<PageRef> pages;
+    std::vector<Frame> frames;
+    std::uint32_t top = 0;
+    int result = 0;
+    InputLog input;
+    std::shared_ptr<StringArena> strings;
+    std::shared_ptr<void> hold;     // keeps the frames' code from being reclaimed
+};
+
+// Contiguous VM-owned stack: calls push a Frame and bump `top` by the
+// callee's slot count instead of recursing on the native stack.
+struct ExecContext {
+    std::vector<Value> stack;
+    std::vector<Frame> frames;  // frames.back().pc is saved on yield
+    std::uint32_t top = 0;
+    int result = 0;             // set once the outermost frame returns
+    bool pinned = false;        // holds VM::liveEpochs[pinEpoch]
+    std::uint64_t pinEpoch = 0;
+    // Slots below dirtyFrom still match `pages`, the latest checkpoint.
+    // Only the current frame is written, so entering a frame lowers it.
+    std::uint32_t dirtyFrom = 0;
+    std::vector<PageRef> pages;
+    InputLog input;
+    std::shared_ptr<StringArena> strings;   // runtime text; created on first `+`
+};
+
+enum class RunState { Done, Yielded, Error };
+
+// Immutable snapshot of the callable functions. Hot swapping publishes a new
+// table with an atomic store; calls load it without locking, and frames
+// keep running the LoadedFunc they were entered with.
+struct FuncTable {
+    std::uint64_t epoch = 0;
+    std::vector<const LoadedFunc*> funcs;
+    std::unordered_map<std::string, std::uint32_t> index;
+};
+
+// -----------------------------
+// Capsules:
+// -----------------------------
+// A .cmajcapsule is a compiled module as the loader would leave it: IR,
+// pre-decoded code and resolved operands, all fixed-size records over a
+// shared string pool. It is mmap'ed; opening checks only the header and
+// function directory, and each function is validated and materialized the
+// first time it is called.
+//
+//   CapsuleHeader | CapsuleFuncEntry[nfuncs] | string pool | function blobs
+//   string pool:    u64 offsets[nstrings + 1], then the bytes
+//   function blob:  u32 params[], CapsuleIR[nir], DInstr[ncode],
+//                   Operand3[nir], u32 args[], u32 strings[], u64 consts[]
+//
+// Records are host-endian; `abi` rejects capsules from a different layout.
+
+constexpr char CAPSULE_MAGIC[8] = { 'C', 'M', 'A', 'J', 'C', 'A', 'P', '\0' };
+constexpr std::uint32_t CAPSULE_VERSION = 3;
+constexpr std::uint32_t CAPSULE_ABI =
+    static_cast<std::uint32_t>(sizeof(DInstr)) << 16 | static_cast<std::uint32_t>(VOP_COUNT);
+
+struct CapsuleHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t abi;
+    std::uint32_t nfuncs;
+    std::uint32_t nstrings;
+    std::uint64_t dirOff;
+    std::uint64_t strOff;
+    std::uint64_t size;         // whole file
+    std::uint64_t poolSum;      // string pool, checked on first materialize
+    std::uint64_t checksum;     // header (with this field zero) + directory
+};
+
+struct CapsuleFuncEntry {
+    std::uint32_t name, nparams, nir, ncode, nargs, nstrings, nslots, nconsts;
+    std::uint64_t off, bytes;   // blob
+    std::uint64_t checksum;     // blob
+};
+
+struct CapsuleIR {
+    std::uint32_t op, a, b, c;  // a/b/c are string ids
+    std::uint32_t line;
+};
+
+static std::uint64_t fnv1a(const void* data, std::size_t n, std::uint64_t h = 14695981039346656037ull) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < n; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+// Read-only mapping of a capsule file.
+class Capsule {
+public:
+    ~Capsule() { if (base) munmap(const_cast<unsigned char*>(base), size); }
+
+    static std::shared_ptr<Capsule> open(const std::string& path, std::string& err) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { err = "cannot open " + path; return nullptr; }
+        struct stat st;
+        void* p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { err = "cannot map " + path; return nullptr; }
+        auto cap = std::shared_ptr<Capsule>(new Capsule());
+        cap->base = static_cast<const unsigned char*>(p);
+        cap->size = static_cast<std::size_t>(st.st_size);
+        if (!cap->check(err)) return nullptr;
+        return cap;
+    }
+
+    std::uint32_t funcCount() const { return header().nfuncs; }
+    std::uint32_t stringCount() const { return header().nstrings; }
+
+    CapsuleFuncEntry entry(std::uint32_t i) const {
+        return read<CapsuleFuncEntry>(header().dirOff + i * sizeof(CapsuleFuncEntry));
+    }
+
+    // String `id`; false if the pool entry is out of bounds.
+    bool str(std::uint32_t id, std::string& out) const {
+        if (id >= header().nstrings) return false;
+        std::uint64_t from = read<std::uint64_t>(header().strOff + id * 8ull);
+        std::uint64_t to = read<std::uint64_t>(header().strOff + (id + 1) * 8ull);
+        std::uint64_t bytes = header().strOff + (header().nstrings + 1) * 8ull;
+        if (from > to || to > size || bytes + to > size) return false;
+        out.assign(reinterpret_cast<const char*>(base + bytes + from), to - from);
+        return true;
+    }
+
+    bool poolIntact() const {
+        std::uint64_t end = header().strOff + (header().nstrings + 1) * 8ull;
+        std::uint64_t last = read<std::uint64_t>(header().strOff + header().nstrings * 8ull);
+        return last <= size && end + last <= size
+            && fnv1a(base + header().strOff, end + last - header().strOff) == header().poolSum;
+    }
+
+    const unsigned char* at(std::uint64_t off) const { return base + off; }
+    std::size_t bytes() const { return size; }
+
+    template<typename T> T read(std::uint64_t off) const {
+        T v;
+        std::memcpy(&v, base + off, sizeof(T));
+        return v;
+    }
+
+private:
+    const unsigned char* base = nullptr;
+    std::size_t size = 0;
+
+    Capsule() = default;
+
+    const CapsuleHeader& header() const { return *reinterpret_cast<const CapsuleHeader*>(base); }
+
+    bool check(std::string& err) {
+        if (size < sizeof(CapsuleHeader) || std::memcmp(base, CAPSULE_MAGIC, 8) != 0) {
+            err = "not a capsule";
+            return false;
+        }
+        CapsuleHeader h = header();
+        if (h.version != CAPSULE_VERSION) { err = "unsupported capsule version " + std::to_string(h.version); return false; }
+        if (h.abi != CAPSULE_ABI) { err = "capsule built for a different VM layout"; return false; }
+        std::uint64_t dirEnd = h.dirOff + static_cast<std::uint64_t>(h.nfuncs) * sizeof(CapsuleFuncEntry);
+        if (h.size != size || h.dirOff < sizeof(CapsuleHeader) || dirEnd > size
+            || h.strOff < dirEnd || h.strOff + (h.nstrings + 1ull) * 8 > size) {
+            err = "truncated capsule";
+            return false;
+        }
+        std::uint64_t sum = h.checksum;
+        h.checksum = 0;
+        if (fnv1a(base + h.dirOff, dirEnd - h.dirOff, fnv1a(&h, sizeof h)) != sum) {
+            err = "capsule directory checksum mismatch";
+            return false;
+        }
+        return true;
+    }
+};
+
+// -----------------------------
+// Profiler:
+// -----------------------------
+// --profile samples the VM on SIGPROF (setitimer, process CPU time). The
+// handler copies the interrupted thread's logical stack, one (function, pc)
+// pair per frame, into that thread's ring and returns; a drain thread folds
+// the rings into per-stack counts. Function names and source lines are only
+// looked up when the report is written. Exact mode also counts every
+// dispatch per opcode and per function; that costs far more than sampling.
+constexpr std::uint32_t PROF_DEPTH = 32;    // frames kept per sample, leaf first
+
+struct ProfSample {
+    std::uint32_t depth;                    // 0: the thread was outside the VM
+    std::uint32_t pcs[PROF_DEPTH];
+    const LoadedFunc* fns[PROF_DEPTH];
+};
+
+// One per thread. The run loop writes cx / fn / pc and the handler reads
+// them on the same thread, so volatile stores are all the ordering needed.
+// fn and pc are only published on calls, returns and back-edges (every
+// dispatch in exact mode), so a sample lands on the last of those taken:
+// the head of the loop or the entry of the function it interrupted.
+struct ProfSlot {
+    static constexpr std::uint32_t RING = 1024;
+    const ExecContext* volatile cx = nullptr;   // context running here
+    const LoadedFunc* volatile fn = nullptr;    // its current function
+    volatile std::uint32_t pc = 0;
+    volatile bool resizing = false;             // cx->frames is reallocating
+    std::unique_ptr<ProfSample[]> ring{ new ProfSample[RING] };
+    std::atomic<std::uint32_t> head{ 0 }, tail{ 0 };   // handler pushes, drainer pops
+    std::atomic<std::uint64_t> dropped{ 0 };
+    // exact mode; read once the VM is idle
+    std::uint64_t ops[VOP_COUNT] = {};
+    std::vector<std::uint64_t> fnOps, calls;    // by LoadedFunc::index
+};
+
+class Profiler {
+public:
+    using Stack = std::vector<std::pair<const LoadedFunc*, std::uint32_t>>;   // leaf first
+
+    Profiler(int intervalUs, bool exact) : exact(exact), id(++lastId) {
+        active.store(this);
+        struct sigaction sa {};
+        sa.sa_handler = onSignal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, &oldAction);
+        drainer = std::thread([this] {
+            while (running.load()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                drain();
+            }
+        });
+        itimerval it {};
+        intervalUs = std::max(intervalUs, 1);
+        it.it_interval.tv_sec = intervalUs / 1000000;
+        it.it_interval.tv_usec = intervalUs % 1000000;
+        it.it_value = it.it_interval;
+        setitimer(ITIMER_PROF, &it, nullptr);
+    }
+    ~Profiler() { stop(); }
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Stop sampling and fold what is left; safe to call twice.
+    void stop() {
+        if (!running.exchange(false)) return;
+        itimerval off {};
+        setitimer(ITIMER_PROF, &off, nullptr);
+        drainer.join();
+        sigaction(SIGPROF, &oldAction, nullptr);
+        active.store(nullptr);
+        drain();
+    }
+
+    // The calling thread's slot, created on first use.
+    ProfSlot* slot() {
+        if (tlsOwner == id) return tlsSlot;
+        auto s = std::make_unique<ProfSlot>();
+        tlsSlot = s.get();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            slots.push_back(std::move(s));
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        tlsOwner = id;                      // the handler trusts tlsSlot from here on
+        return tlsSlot;
+    }
+
+    // Folded stacks (root;...;leaf count) for flamegraph.pl / speedscope,
+    // then a report: hottest instructions with their source lines and, in
+    // exact mode, dispatch counts. `known` holds the functions that are
+    // still loaded; samples in freed (hot-swapped) code print as [retired].
+    void write(std::ostream& folded, std::ostream& report, std::size_t top,
+               const std::unordered_set<const LoadedFunc*>& known) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto name = [&](const LoadedFunc* f) -> std::string { return known.count(f) ? f->ir->name : "[retired]"; };
+        std::uint64_t total = outside.load(), dropped = 0;
+        std::map<std::pair<const LoadedFunc*, std::uint32_t>, std::uint64_t> hot;
+        std::map<std::string, std::uint64_t> byName;
+        for (auto& kv : stacks) {
+            total += kv.second;
+            std::string line;
+            for (auto it = kv.first.rbegin(); it != kv.first.rend(); ++it)
+                line += (line.empty() ? "" : ";") + name(it->first);
+            byName[line.empty() ? "[native]" : line] += kv.second;
+            if (!kv.first.empty()) hot[kv.first.front()] += kv.second;
+        }
+        if (outside.load()) byName["[other threads]"] += outside.load();
+        for (auto& kv : byName) folded << kv.first << ' ' << kv.second << '\n';
+        for (auto& s : slots) dropped += s->dropped.load();
+
+        std::vector<std::pair<std::uint64_t, std::pair<const LoadedFunc*, std::uint32_t>>> order;
+        for (auto& kv : hot) order.push_back({ kv.second, kv.first });
+        std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        if (top && order.size() > top) order.resize(top);
+        report << "profile: " << total << " samples";
+        if (dropped) report << ", " << dropped << " dropped";
+        report << "\n  samples      %  function             pc  line  op\n";
+        char buf[256];
+        for (auto& o : order) {
+            const LoadedFunc* f = o.second.first;
+            std::uint32_t pc = o.second.second;
+            std::string fname = name(f), op = "?", ir;
+            int srcLine = 0;
+            if (known.count(f) && pc < f->code.size()) {
+                const DInstr& d = f->code[pc];
+                op = vopName(d.op);
+                if (d.src < f->ir->code.size()) {
+                    const IRInst& in = f->ir->code[d.src];
+                    srcLine = in.line;
+                    ir = std::string(irOpName(in.op)) + " " + in.a + (in.b.empty() ? "" : " " + in.b) + (in.c.empty() ? "" : " " + in.c);
+                }
+            }
+            std::snprintf(buf, sizeof buf, "%9llu %6.2f  %-18s %5u %5d  %-14s %s\n",
+                          static_cast<unsigned long long>(o.first), total ? 100.0 * o.first / total : 0.0,
+                          fname.c_str(), pc, srcLine, op.c_str(), ir.c_str());
+            report << buf;
+        }
+        if (!exact) return;
+        std::uint64_t ops[VOP_COUNT] = {};
+        std::map<std::string, std::pair<std::uint64_t, std::uint64_t>> perFn;   // name -> dispatches, calls
+        std::unordered_map<std::uint32_t, std::string> byIndex;
+        for (auto* f : known) byIndex[f->index] = f->ir->name;
+        for (auto& s : slots) {
+            for (unsigned k = 0; k < VOP_COUNT; ++k) ops[k] += s->ops[k];
+            for (std::size_t k = 0; k < s->fnOps.size(); ++k) perFn[byIndex[static_cast<std::uint32_t>(k)]].first += s->fnOps[k];
+            for (std::size_t k = 0; k < s->calls.size(); ++k) perFn[byIndex[static_cast<std::uint32_t>(k)]].second += s->calls[k];
+        }
+        report << "dispatches per opcode:\n";
+        for (unsigned k = 0; k < VOP_COUNT; ++k)
+            if (ops[k]) report << "  " << ops[k] << '\t' << vopName(static_cast<VOp>(k)) << '\n';
+        report << "dispatches / calls per function:\n";
+        for (auto& kv : perFn)
+            if (kv.second.first || kv.second.second)
+                report << "  " << kv.second.first << '\t' << kv.second.second << '\t' << kv.first << '\n';
+    }
+
+    const bool exact;
+
+private:
+    static inline std::atomic<Profiler*> active{ nullptr };
+    static inline std::atomic<std::uint64_t> lastId{ 0 };
+    static inline thread_local std::uint64_t tlsOwner = 0;
+    static inline thread_local ProfSlot* tlsSlot = nullptr;
+
+    const std::uint64_t id;
+    std::atomic<bool> running{ true };
+    std::thread drainer;
+    struct sigaction oldAction {};
+    std::mutex mtx;                         // slots, stacks
+    std::vector<std::unique_ptr<ProfSlot>> slots;
+    std::map<Stack, std::uint64_t> stacks;
+    std::atomic<std::uint64_t> outside{ 0 };   // samples on threads that never ran VM code
+
+    static void onSignal(int) {
+        Profiler* p = active.load(std::memory_order_relaxed);
+        if (!p) return;
+        if (tlsOwner != p->id) { p->outside.fetch_add(1, std::memory_order_relaxed); return; }
+        ProfSlot* s = tlsSlot;
+        std::uint32_t h = s->head.load(std::memory_order_relaxed);
+        if (h - s->tail.load(std::memory_order_acquire) == ProfSlot::RING) {
+            s->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ProfSample& out = s->ring[h % ProfSlot::RING];
+        out.depth = 0;
+        if (const ExecContext* cx = s->cx) {
+            out.fns[0] = s->fn;
+            out.pcs[0] = s->pc;
+            out.depth = 1;
+            std::size_t n = cx->frames.size();
+            if (!s->resizing && n > 1) {
+                const Frame* fr = cx->frames.data();
+                // callers hold their return pc; report the call itself
+                for (std::size_t k = n - 1; k-- > 0 && out.depth < PROF_DEPTH; ++out.depth) {
+                    out.fns[out.depth] = fr[k].fn;
+                    out.pcs[out.depth] = fr[k].pc ? fr[k].pc - 1 : 0;
+                }
+            }
+        }
+        s->head.store(h + 1, std::memory_order_release);
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> lock(mtx);
+        Stack key;
+        for (auto& s : slots) {
+            std::uint32_t t = s->tail.load(std::memory_order_relaxed);
+            std::uint32_t h = s->head.load(std::memory_order_acquire);
+            for (; t != h; ++t) {
+                const ProfSample& smp = s->ring[t % ProfSlot::RING];
+                key.clear();
+                for (std::uint32_t k = 0; k < smp.depth; ++k) key.push_back({ smp.fns[k], smp.pcs[k] });
+                ++stacks[key];
+            }
+            s->tail.store(t, std::memory_order_release);
+        }
+    }
 };
 
 // -----------------------------
@@ -46,199 +1056,1610 @@ struct IRModule {
 // -----------------------------
 class VM {
 public:
-    explicit VM(const IRModule& m) : mod(m) {
-        for (std::size_t i = 0; i < mod.funcs.size(); ++i) {
-            funcIndex[mod.funcs[i].name] = i;
+    explicit VM(const IRModule& m, SuperopTable ops = SuperopTable::defaults())
+        : superops(std::move(ops)) {
+        rankSuperops(m);
+        auto t = std::make_unique<FuncTable>();
+        for (std::size_t i = 0; i < m.funcs.size(); ++i)
+            t->index[m.funcs[i].name] = static_cast<std::uint32_t>(i);
+        for (std::size_t i = 0; i < m.funcs.size(); ++i) {
+            auto lf = std::make_unique<LoadedFunc>();
+            lf->ir = &m.funcs[i];
+            lf->index = static_cast<std::uint32_t>(i);
+            decode(*lf, t->index);
+            t->funcs.push_back(lf.get());
+            live.push_back(std::move(lf));
+        }
+        current = std::move(t);
+        table.store(current.get(), std::memory_order_release);
+    }
+
+    // Start from a mapped capsule: only function names are read here; each
+    // function is validated and materialized on its first call.
+    explicit VM(std::shared_ptr<const Capsule> cap, SuperopTable ops = SuperopTable::defaults())
+        : superops(std::move(ops)), capsule(std::move(cap)) {
+        auto t = std::make_unique<FuncTable>();
+        for (std::uint32_t i = 0; i < capsule->funcCount(); ++i) {
+            std::string name;
+            capsule->str(capsule->entry(i).name, name);
+            t->index[name] = i;
+            auto lf = std::make_unique<LoadedFunc>();
+            lf->index = i;
+            lf->ready.store(false, std::memory_order_relaxed);
+            t->funcs.push_back(lf.get());
+            live.push_back(std::move(lf));
+        }
+        current = std::move(t);
+        table.store(current.get(), std::memory_order_release);
+    }
+
+    ~VM() {
+        stopTimers();
+        stopTrace();
+        pool.reset();
+    }
+
+    // --profile: sample every thread running this VM each intervalUs of
+    // process CPU time. Call before running anything.
+    void startProfile(int intervalUs, bool exact) { profiler = std::make_unique<Profiler>(intervalUs, exact); }
+
+    // Stop sampling and write folded stacks to `folded` and the hot
+    // instruction table (top N) to `report`.
+    void writeProfile(std::ostream& folded, std::ostream& report, std::size_t top) {
+        if (!profiler) return;
+        profiler->stop();
+        std::unordered_set<const LoadedFunc*> known;
+        std::lock_guard<std::mutex> lock(swapMtx);
+        for (auto& f : live) known.insert(f.get());
+        for (auto& r : retired)
+            for (auto& f : r.funcs) known.insert(f.get());
+        profiler->write(folded, report, top, known);
+    }
+
+    // --trace: every thread running this VM records calls, returns, taken
+    // branches, says and timer firings into <prefix>.<n>. Call before
+    // running anything.
+    void startTrace(const std::string& prefix, std::uint64_t events) { tracer = std::make_unique<Tracer>(prefix, events); }
+
+    // Write <prefix>.names and close the rings. Stop the timers first.
+    bool stopTrace() {
+        if (!tracer) return true;
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(swapMtx);
+            const FuncTable* t = table.load(std::memory_order_acquire);
+            for (const LoadedFunc* f : t->funcs) names.push_back(f->ir->name);
+        }
+        bool ok = tracer->finish(names);
+        tracer.reset();
+        return ok;
+    }
+
+    // Write the loaded module as a .cmajcapsule (layout above).
+    bool saveCapsule(const std::string& path) {
+        const FuncTable* t = table.load(std::memory_order_acquire);
+        std::vector<std::string> pool;
+        std::unordered_map<std::string, std::uint32_t> ids;
+        auto id = [&](const std::string& text) {
+            auto it = ids.find(text);
+            if (it != ids.end()) return it->second;
+            ids.emplace(text, static_cast<std::uint32_t>(pool.size()));
+            pool.push_back(text);
+            return static_cast<std::uint32_t>(pool.size() - 1);
+        };
+        std::vector<CapsuleFuncEntry> dir(t->funcs.size());
+        std::vector<std::string> blobs(t->funcs.size());
+        for (std::size_t i = 0; i < t->funcs.size(); ++i) {
+            const LoadedFunc& f = *t->funcs[i];
+            if (!ensure(f)) return false;
+            std::string& b = blobs[i];
+            auto put = [&](const void* p, std::size_t n) { b.append(static_cast<const char*>(p), n); };
+            auto putId = [&](const std::string& text) { std::uint32_t v = id(text); put(&v, 4); };
+            CapsuleFuncEntry& e = dir[i];
+            e = CapsuleFuncEntry{};
+            e.name = id(f.ir->name);
+            e.nparams = static_cast<std::uint32_t>(f.ir->params.size());
+            e.nir = static_cast<std::uint32_t>(f.ir->code.size());
+            e.ncode = static_cast<std::uint32_t>(f.code.size());
+            e.nargs = static_cast<std::uint32_t>(f.args.size());
+            e.nstrings = static_cast<std::uint32_t>(f.strings.size());
+            e.nslots = f.nslots;
+            e.nconsts = static_cast<std::uint32_t>(f.consts.size());
+            for (auto& p : f.ir->params) putId(p);
+            for (auto& ins : f.ir->code) {
+                CapsuleIR r{ static_cast<std::uint32_t>(ins.op), id(ins.a), id(ins.b), id(ins.c),
+                             static_cast<std::uint32_t>(ins.line) };
+                put(&r, sizeof r);
+            }
+            for (auto& d : f.code) {
+                // Field by field so padding is written as zeros.
+                char rec[sizeof(DInstr)] = {};
+                std::memcpy(rec + offsetof(DInstr, op), &d.op, sizeof d.op);
+                std::memcpy(rec + offsetof(DInstr, a), &d.a, sizeof d.a);
+                std::memcpy(rec + offsetof(DInstr, b), &d.b, sizeof d.b);
+                std::memcpy(rec + offsetof(DInstr, c), &d.c, sizeof d.c);
+                std::memcpy(rec + offsetof(DInstr, src), &d.src, sizeof d.src);
+                std::memcpy(rec + offsetof(DInstr, target), &d.target, sizeof d.target);
+                std::memcpy(rec + offsetof(DInstr, imm), &d.imm, sizeof d.imm);
+                put(rec, sizeof rec);
+            }
+            put(f.ops.data(), f.ops.size() * sizeof(Operand3));
+            put(f.args.data(), f.args.size() * sizeof(std::uint32_t));
+            for (auto* text : f.strings) putId(*text);
+            for (auto& v : f.consts) { std::uint64_t r = v.raw(); put(&r, 8); }
+            e.bytes = b.size();
+            e.checksum = fnv1a(b.data(), b.size());
+        }
+        std::vector<std::uint64_t> offs;
+        std::string bytes;
+        for (auto& text : pool) { offs.push_back(bytes.size()); bytes += text; }
+        offs.push_back(bytes.size());
+
+        auto align8 = [](std::uint64_t v) { return (v + 7) & ~std::uint64_t(7); };
+        CapsuleHeader h{};
+        std::memcpy(h.magic, CAPSULE_MAGIC, 8);
+        h.version = CAPSULE_VERSION;
+        h.abi = CAPSULE_ABI;
+        h.nfuncs = static_cast<std::uint32_t>(dir.size());
+        h.nstrings = static_cast<std::uint32_t>(pool.size());
+        h.dirOff = sizeof h;
+        h.strOff = h.dirOff + dir.size() * sizeof(CapsuleFuncEntry);
+        std::uint64_t off = align8(h.strOff + offs.size() * 8 + bytes.size());
+        for (auto& e : dir) { e.off = off; off = align8(off + e.bytes); }
+        h.size = off;
+        h.poolSum = fnv1a(bytes.data(), bytes.size(), fnv1a(offs.data(), offs.size() * 8));
+        h.checksum = fnv1a(dir.data(), dir.size() * sizeof(CapsuleFuncEntry), fnv1a(&h, sizeof h));
+
+        std::ofstream out(path, std::ios::binary);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&h), sizeof h);
+        out.write(reinterpret_cast<const char*>(dir.data()), dir.size() * sizeof(CapsuleFuncEntry));
+        out.write(reinterpret_cast<const char*>(offs.data()), offs.size() * 8);
+        out.write(bytes.data(), bytes.size());
+        for (std::size_t i = 0; i < dir.size(); ++i) {
+            out << std::string(dir[i].off - static_cast<std::uint64_t>(out.tellp()), '\0');
+            out.write(blobs[i].data(), blobs[i].size());
+        }
+        out << std::string(h.size - static_cast<std::uint64_t>(out.tellp()), '\0');
+        return static_cast<bool>(out);
+    }
+
+    // Hot swap: publish every function of `m` whose IR differs from the
+    // running version (new names are added). In-flight frames finish on the
+    // old code; calls made after this returns enter the new code. Old
+    // versions are freed once no context pinned before the swap is alive.
+    std::size_t swap(const IRModule& m) {
+        std::lock_guard<std::mutex> lock(swapMtx);
+        auto t = std::make_unique<FuncTable>(*current);
+        std::vector<std::unique_ptr<LoadedFunc>> replaced;
+        std::vector<std::unique_ptr<LoadedFunc>> fresh;
+        for (auto& f : m.funcs) {
+            auto it = t->index.find(f.name);
+            if (it != t->index.end() && ensure(*live[it->second])
+                && sameIR(*live[it->second]->ir, f)) continue;
+            auto lf = std::make_unique<LoadedFunc>();
+            lf->own = std::make_unique<IRFunction>(f);
+            lf->ir = lf->own.get();
+            if (it == t->index.end()) {
+                lf->index = static_cast<std::uint32_t>(t->funcs.size());
+                t->index[f.name] = lf->index;
+                t->funcs.push_back(nullptr);
+            } else {
+                lf->index = it->second;
+            }
+            fresh.push_back(std::move(lf));
+        }
+        if (fresh.empty()) return 0;
+        // Decode against the new name index so new code can call new functions.
+        for (auto& lf : fresh) {
+            decode(*lf, t->index);
+            t->funcs[lf->index] = lf.get();
+            if (lf->index < live.size()) {
+                replaced.push_back(std::move(live[lf->index]));
+                live[lf->index] = std::move(lf);
+            } else {
+                live.resize(lf->index + 1);
+                live[lf->index] = std::move(lf);
+            }
+        }
+        std::size_t count = fresh.size();
+        std::lock_guard<std::mutex> lk(liveMtx);
+        t->epoch = current->epoch + 1;
+        table.store(t.get(), std::memory_order_release);
+        retired.push_back({ t->epoch, std::move(current), std::move(replaced) });
+        current = std::move(t);
+        epoch = current->epoch;
+        reclaim();
+        return count;
+    }
+
+    // Contexts pin the epoch they started in; retired code is freed only
+    // when every pinned epoch is newer than the swap that retired it.
+    void pin(ExecContext& cx) {
+        if (cx.pinned) return;
+        std::lock_guard<std::mutex> lock(liveMtx);
+        cx.pinned = true;
+        cx.pinEpoch = epoch;
+        ++liveEpochs[cx.pinEpoch];
+    }
+
+    void unpin(ExecContext& cx) {
+        if (!cx.pinned) return;
+        std::lock_guard<std::mutex> lock(liveMtx);
+        release(cx.pinEpoch);
+        cx.pinned = false;
+        reclaim();
+    }
+
+    // Move a suspended context's pin up to its oldest frame (fiber yields).
+    void repin(ExecContext& cx) {
+        if (!cx.pinned || cx.frames.empty() || cx.frames.front().epoch <= cx.pinEpoch) return;
+        std::lock_guard<std::mutex> lock(liveMtx);
+        release(cx.pinEpoch);
+        cx.pinEpoch = cx.frames.front().epoch;
+        ++liveEpochs[cx.pinEpoch];
+        reclaim();
+    }
+
+    // Snapshot a suspended cx. Costs a copy of the pages at or above the
+    // lowest frame entered since the previous checkpoint, plus one pointer
+    // per page. The VM must outlive the checkpoint.
+    Checkpoint checkpoint(ExecContext& cx) {
+        std::uint32_t npages = (cx.top + CHECKPOINT_PAGE - 1) / CHECKPOINT_PAGE;
+        cx.pages.resize(npages);
+        for (std::uint32_t p = std::min(cx.dirtyFrom / CHECKPOINT_PAGE, npages); p < npages; ++p) {
+            auto page = std::make_shared<CheckpointPage>();
+            std::uint32_t from = p * CHECKPOINT_PAGE;
+            std::copy_n(cx.stack.begin() + from, std::min(CHECKPOINT_PAGE, cx.top - from), page->slots);
+            cx.pages[p] = std::move(page);
         }
+        cx.dirtyFrom = cx.frames.empty() ? cx.top : cx.frames.back().base;
+        Checkpoint ck;
+        ck.pages = cx.pages;
+        ck.frames = cx.frames;
+        ck.top = cx.top;
+        ck.result = cx.result;
+        ck.input = cx.input;
+        ck.strings = cx.strings;
+        if (!cx.frames.empty()) ck.hold = hold(cx.frames.front().epoch);
+        return ck;
+    }
+
+    // Restore cx to ck; resume() then re-executes from that point. Only
+    // pages that differ from ck are copied back.
+    void rewind(ExecContext& cx, const Checkpoint& ck) {
+        std::size_t npages = ck.pages.size();
+        if (cx.stack.size() < npages * CHECKPOINT_PAGE) cx.stack.resize(npages * CHECKPOINT_PAGE);
+        std::size_t clean = std::min<std::size_t>(cx.dirtyFrom / CHECKPOINT_PAGE, cx.pages.size());
+        for (std::size_t p = 0; p < npages; ++p) {
+            if (p < clean && cx.pages[p] == ck.pages[p]) continue;
+            std::copy_n(ck.pages[p]->slots, CHECKPOINT_PAGE, cx.stack.begin() + p * CHECKPOINT_PAGE);
+        }
+        cx.pages = ck.pages;
+        cx.frames = ck.frames;
+        cx.top = ck.top;
+        cx.result = ck.result;
+        cx.input = ck.input;
+        cx.strings = ck.strings;
+        cx.dirtyFrom = cx.top;
+        if (cx.frames.empty()) return;
+        // The restored frames may predate cx's pin; ck.hold keeps their epoch live.
+        std::lock_guard<std::mutex> lock(liveMtx);
+        if (cx.pinned) release(cx.pinEpoch);
+        cx.pinned = true;
+        cx.pinEpoch = cx.frames.front().epoch;
+        ++liveEpochs[cx.pinEpoch];
+    }
+
+    // Restart cx from its recorded input log.
+    bool replay(ExecContext& cx) {
+        InputLog in = cx.input;
+        return in.entry != NO_FUNC && start(cx, in.entry, in.args.data(), in.args.size());
+    }
+
+    // Frames deeper than this abort the run with an error (0 = unlimited).
+    void setMaxDepth(std::size_t depth) { maxDepth = depth; }
+
+    // PARFOR loops with fewer than `minTrip` iterations, or a pool of at
+    // most one worker, run serially on the calling thread.
+    void setParallel(std::size_t workers, std::int64_t minTrip) {
+        parWorkers = workers;
+        parMinTrip = minTrip;
+    }
+
+    // Worker threads for schedule / every (0 = one per core). Takes effect
+    // when the first timer is registered.
+    void setTimerWorkers(std::size_t workers) { timerWorkers = workers; }
+
+    // Per-capsule timer lag / run time / queue depth, rewritten to `path`
+    // every `ms` and when the timers stop; JSON if path ends in .json.
+    void setTimerStats(const std::string& path, std::int64_t ms) { timerStatsPath = path; timerStatsMs = ms; }
+
+    // Binary mutation log (Scheduler::dumpMutations), written to `path` when
+    // the timers stop; nothing is written if no timer was ever registered.
+    void setTimerLog(const std::string& path) { timerLogPath = path; }
+
+    // Block until no schedule / every timer is pending or running, at most
+    // `ms` milliseconds (< 0 = no limit). False if timers are still live.
+    bool waitTimers(std::int64_t ms) {
+        std::unique_lock<std::mutex> lock(timerMtx);
+        if (!timers) return true;
+        OutputSink::instance().flushThread();      // the caller's output goes first
+        Scheduler& sc = *timers;
+        lock.unlock();
+        return sc.waitIdle(ms);
+    }
+
+    // Cancel every timer and join the timer threads; running bodies finish
+    // first. False if the timer log could not be written.
+    bool stopTimers() {
+        std::lock_guard<std::mutex> lock(timerMtx);
+        if (!timers) return true;
+        timers->stop();
+        timerThread.join();
+        bool ok = timerLogPath.empty() || timers->dumpMutations(timerLogPath);
+        timers.reset();
+        return ok;
     }
 
     // Call a function by name with optional integer args (positional).
-    int call(const std::string& name, const std::vector<int>& args = {}) {
-        auto it = funcIndex.find(name);
-        if (it == funcIndex.end()) {
+    // False if there is no such function or the run stopped on an error
+    // (depth limit, corrupt capsule function); `result` gets the return value.
+    bool call(const std::string& name, const std::vector<int>& args = {}, int* result = nullptr) {
+        ExecContext cx;
+        bool ok = start(cx, name, args) && resume(cx, 0) == RunState::Done;
+        unpin(cx);
+        if (result) *result = cx.result;
+        return ok;
+    }
+
+    // REPL: run `name` with `vars` as its leading parameters, then store
+    // the parameters' final values back so they outlive the call. On a
+    // runtime error vars keep their old values.
+    bool callWith(const std::string& name, std::vector<Value>& vars) {
+        ExecContext cx;
+        pin(cx);
+        const FuncTable* t = table.load(std::memory_order_acquire);
+        auto it = t->index.find(name);
+        bool ok = false;
+        if (it == t->index.end()) std::cerr << "Unknown function: " << name << '\n';
+        else if (start(cx, it->second, vars.data(), vars.size()) && resume(cx, 0) == RunState::Done) {
+            // the entry frame's slots start at 0 and are left as they were at return
+            for (std::size_t k = 0; k < vars.size(); ++k) vars[k] = keep(cx.stack[k]);
+            ok = true;
+        }
+        unpin(cx);
+        return ok;
+    }
+
+    // A value as `say` would print it.
+    static std::string text(Value v) { return show(v); }
+
+    // Prepare cx to run `name`; execution happens in resume(). Pins cx;
+    // the owner unpins it once the context is finished with.
+    bool start(ExecContext& cx, const std::string& name, const std::vector<int>& args = {}) {
+        pin(cx);
+        const FuncTable* t = table.load(std::memory_order_acquire);
+        auto it = t->index.find(name);
+        if (it == t->index.end()) {
             std::cerr << "Unknown function: " << name << '\n';
-            return 0;
+            return false;
+        }
+        return start(cx, it->second, args);
+    }
+
+    bool start(ExecContext& cx, std::size_t entry, const std::vector<int>& args) {
+        std::vector<Value> slots;
+        for (int v : args) slots.push_back(Value::fromInt(v));
+        return start(cx, entry, slots.data(), slots.size());
+    }
+
+    bool start(ExecContext& cx, std::size_t entry, const Value* args, std::size_t argc) {
+        pin(cx);
+        cx.frames.clear();
+        cx.top = 0;
+        cx.result = 0;
+        cx.dirtyFrom = 0;
+        // Reuse the arena unless a checkpoint still refers to it.
+        if (cx.strings.use_count() == 1) {
+            cx.strings->nodes.clear();
+            cx.strings->texts.clear();
+            cx.strings->vecs.clear();
+            cx.strings->collectAt = StringArena::COLLECT_MIN;
+        } else {
+            cx.strings.reset();
+        }
+        cx.input.entry = static_cast<std::uint32_t>(entry);
+        cx.input.args.assign(args, args + argc);
+        const FuncTable* t = table.load(std::memory_order_acquire);
+        const LoadedFunc& fn = *t->funcs[entry];
+        if (!ensure(fn) || !pushFrame(cx, fn, NO_SLOT, t->epoch)) return false;
+        for (std::size_t i = 0; i < fn.ir->params.size() && i < argc; ++i)
+            cx.stack[i] = args[i];
+        return true;
+    }
+
+    // Run cx until it returns or `budget` back-edges/calls have been
+    // executed (0 = no budget); a Yielded context resumes where it stopped.
+    RunState resume(ExecContext& cx, std::uint32_t budget) {
+        if (cx.frames.empty()) return RunState::Done;
+        return run(cx, budget);
+    }
+
+    // Fusion table with per-pattern counts, then per-function dispatch savings.
+    void dumpSuperops(std::ostream& os) const {
+        os << "; SUPEROPS (" << (superops.enabled ? "enabled" : "disabled") << ")\n";
+        os << "; name            static  profile  fused  sequence\n";
+        for (auto& p : superops.patterns) {
+            os << "  " << p.name;
+            for (std::size_t k = std::string(p.name).size(); k < 16; ++k) os << ' ';
+            os << p.staticCount << "\t" << p.profileCount << "\t" << p.fusedSites << "\t";
+            for (std::size_t k = 0; k < p.seq.size(); ++k) os << (k ? " " : "") << irOpName(p.seq[k]);
+            os << "\n";
+        }
+        for (auto* f : table.load(std::memory_order_acquire)->funcs) {
+            if (!ensure(*f)) continue;
+            os << "; FUNC " << f->ir->name << ": " << f->ir->code.size()
+               << " IR -> " << f->code.size() << " dispatches, "
+               << f->nslots << " slots\n";
         }
-        return exec(mod.funcs[it->second], args);
     }
 
 private:
-    const IRModule& mod;
-    std::unordered_map<std::string, std::size_t> funcIndex;
+    struct Retired {
+        std::uint64_t epoch;    // first epoch that no longer references these
+        std::unique_ptr<FuncTable> table;
+        std::vector<std::unique_ptr<LoadedFunc>> funcs;
+    };
+
+    SuperopTable superops;
+    std::vector<SuperopPattern*> ranked;
+    std::shared_ptr<const Capsule> capsule;
+    mutable std::mutex capsuleMtx;
+    mutable std::mutex internMtx;
+    mutable std::unordered_set<std::string> interned;
+    mutable std::deque<VecNode> keptVecs;           // vectors captured by timers / the REPL
+    mutable bool poolChecked = false;
+    std::atomic<const FuncTable*> table{ nullptr };
+    std::unique_ptr<FuncTable> current;             // owns *table
+    std::vector<std::unique_ptr<LoadedFunc>> live;  // current version per index
+    std::vector<Retired> retired;
+    std::mutex swapMtx, liveMtx;
+    std::map<std::uint64_t, std::size_t> liveEpochs; // pinned epoch -> contexts
+    std::uint64_t epoch = 0;
+    std::size_t maxDepth = 100000;
+    std::size_t parWorkers = std::thread::hardware_concurrency();
+    std::int64_t parMinTrip = 1024;
+    std::unique_ptr<WorkStealingPool> pool;
+    std::once_flag poolOnce;
+    std::size_t timerWorkers = 0;
+    std::string timerStatsPath;
+    std::int64_t timerStatsMs = 1000;
+    std::string timerLogPath;
+    std::mutex timerMtx;
+    std::unique_ptr<Scheduler> timers;             // created by the first timer
+    std::thread timerThread;
+    std::unique_ptr<Profiler> profiler;            // --profile
+    std::unique_ptr<Tracer> tracer;                // --trace
+
+    // Int op int stays int; a double operand promotes the result to double.
+    template<typename F> static Value numeric(Value a, Value b, F f) {
+        if (a.isInt() && b.isInt()) return Value::fromInt(f(a.asInt(), b.asInt()));
+        if (a.isDouble() || b.isDouble()) return Value::fromDouble(f(a.toDouble(), b.toDouble()));
+        return Value::fromInt(f(a.toInt(), b.toInt()));
+    }
+
+    template<typename F> static Value compare(Value a, Value b, F f) {
+        if (a.isInt() && b.isInt()) return Value::fromBool(f(a.asInt(), b.asInt()));
+        if (a.isStr() && b.isStr()) return Value::fromBool(f(*a.asStr(), *b.asStr()));
+        if (a.isText() && b.isText()) return Value::fromBool(f(show(a), show(b)));
+        if (a.isDouble() || b.isDouble()) return Value::fromBool(f(a.toDouble(), b.toDouble()));
+        return Value::fromBool(f(a.toInt(), b.toInt()));
+    }
+
+    static std::string show(Value v) {
+        if (v.isText()) {
+            std::string out;
+            out.reserve(textSize(v));
+            appendText(out, v);
+            return out;
+        }
+        if (v.isBool()) return v.asBool() ? "true" : "false";
+        if (v.isInt()) return std::to_string(v.asInt());
+        char buf[32];
+        if (v.isVec()) {
+            std::string out = "vec(";
+            for (std::uint32_t k = 0; k < v.asVec()->width; ++k) {
+                std::snprintf(buf, sizeof buf, "%.7g", v.asVec()->lane[k]);
+                out += (k ? ", " : "");
+                out += buf;
+            }
+            return out + ")";
+        }
+        std::snprintf(buf, sizeof buf, "%.15g", v.asDouble());
+        return buf;
+    }
+
+    static Value add(ExecContext& cx, Value a, Value b) {
+        if (a.isInt() && b.isInt()) return Value::fromInt(a.asInt() + b.asInt());
+        if (a.isText() || b.isText()) return concat(cx, a, b);
+        if (a.isVec() || b.isVec()) return lanewise(cx, a, b, vecKernels().add);
+        return numeric(a, b, std::plus<>());
+    }
+
+    static Value mul(ExecContext& cx, Value a, Value b) {
+        if (a.isInt() && b.isInt()) return Value::fromInt(a.asInt() * b.asInt());
+        if (a.isVec() || b.isVec()) return lanewise(cx, a, b, vecKernels().mul);
+        return numeric(a, b, std::multiplies<>());
+    }
+
+    // `+` with a text side: numbers are formatted, then both sides are
+    // joined by one rope node, or inline when the result fits in a Value.
+    static Value concat(ExecContext& cx, Value a, Value b) {
+        if (!cx.strings) cx.strings = std::make_shared<StringArena>();
+        StringArena& arena = *cx.strings;
+        auto text = [&](Value v) {
+            if (v.isText()) return v;
+            std::string t = show(v);
+            if (t.size() <= Value::SMALL_MAX) return Value::fromSmall(t.data(), t.size());
+            arena.texts.push_back(std::move(t));
+            return Value::fromStr(&arena.texts.back());
+        };
+        a = text(a);
+        b = text(b);
+        std::size_t n = textSize(a) + textSize(b);
+        if (n == textSize(a)) return a;
+        if (n == textSize(b)) return b;
+        if (n <= Value::SMALL_MAX) {
+            std::string t;
+            appendText(t, a);
+            appendText(t, b);
+            return Value::fromSmall(t.data(), t.size());
+        }
+        arena.nodes.push_back({ a, b, n });
+        return Value::fromRope(&arena.nodes.back());
+    }
+
+    // Copy the arena entries reachable from cx's live slots into a fresh
+    // arena and free the old one. Values that point elsewhere (interned
+    // constants, a parallel loop's captures from its caller's arena) are
+    // left alone. A checkpoint sharing the arena may still rewind to any of
+    // its entries, so then nothing is copied until the arena doubles.
+    static void collectText(ExecContext& cx) {
+        StringArena& from = *cx.strings;
+        if (cx.strings.use_count() != 1) { from.collectAt = from.size() * 2; return; }
+        // The arena's storage as sorted [begin, end) address ranges.
+        std::vector<std::pair<std::uintptr_t, std::uintptr_t>> blocks;
+        auto addBlocks = [&](const auto& entries) {
+            std::uintptr_t begin = 0, end = 0;
+            for (auto& e : entries) {
+                auto at = reinterpret_cast<std::uintptr_t>(&e);
+                if (at != end) {
+                    if (begin != end) blocks.emplace_back(begin, end);
+                    begin = at;
+                }
+                end = at + sizeof e;
+            }
+            if (begin != end) blocks.emplace_back(begin, end);
+        };
+        addBlocks(from.texts);
+        addBlocks(from.nodes);
+        addBlocks(from.vecs);
+        std::sort(blocks.begin(), blocks.end());
+        auto owned = [&](const void* p) {
+            auto at = reinterpret_cast<std::uintptr_t>(p);
+            auto it = std::upper_bound(blocks.begin(), blocks.end(), std::make_pair(at, UINTPTR_MAX));
+            return it != blocks.begin() && at < (--it)->second;
+        };
+        auto to = std::make_shared<StringArena>();
+        std::unordered_map<const void*, Value> moved;
+        // Strings and vectors copy directly; a rope node once its children have.
+        auto leaf = [&](Value v) -> Value {
+            const void* p = v.isStr() ? static_cast<const void*>(v.asStr())
+                          : v.isVec() ? static_cast<const void*>(v.asVec())
+                          : v.isRope() ? static_cast<const void*>(v.asRope()) : nullptr;
+            if (!p || !owned(p)) return v;
+            auto it = moved.find(p);
+            if (it != moved.end()) return it->second;
+            Value c;
+            if (v.isStr()) { to->texts.push_back(*v.asStr()); c = Value::fromStr(&to->texts.back()); }
+            else { to->vecs.push_back(*v.asVec()); c = Value::fromVec(&to->vecs.back()); }
+            moved.emplace(p, c);
+            return c;
+        };
+        auto pending = [&](Value v) { return v.isRope() && owned(v.asRope()) && !moved.count(v.asRope()); };
+        std::vector<const RopeNode*> todo;
+        for (std::uint32_t k = 0; k < cx.top; ++k) {
+            Value v = cx.stack[k];
+            if (pending(v)) todo.push_back(v.asRope());
+            while (!todo.empty()) {
+                const RopeNode* r = todo.back();
+                if (pending(r->left) || pending(r->right)) {
+                    if (pending(r->right)) todo.push_back(r->right.asRope());
+                    if (pending(r->left)) todo.push_back(r->left.asRope());
+                    continue;
+                }
+                todo.pop_back();
+                if (moved.count(r)) continue;
+                to->nodes.push_back({ leaf(r->left), leaf(r->right), r->size });
+                moved.emplace(r, Value::fromRope(&to->nodes.back()));
+            }
+            cx.stack[k] = leaf(v);
+        }
+        to->collectAt = std::max(StringArena::COLLECT_MIN, to->size() * 2);
+        cx.strings = std::move(to);
+        cx.dirtyFrom = 0;   // slots moved; the next checkpoint copies every page
+    }
+
+    // Vectors. A number meeting a vector is broadcast to the vector's
+    // width; between two vectors the result has the wider width, the
+    // narrower side reading 0 in its missing lanes. With no vector operand
+    // the V ops do what the scalar op would.
+
+    static VecNode& newVec(ExecContext& cx, std::uint32_t width) {
+        if (!cx.strings) cx.strings = std::make_shared<StringArena>();
+        VecNode& r = cx.strings->vecs.emplace_back();
+        r.width = width;
+        return r;
+    }
+
+    static std::uint32_t widthOf(Value v) { return v.isVec() ? v.asVec()->width : 0; }
+
+    // The lanes of v as a vector `width` wide.
+    static const float* lanes(Value v, std::uint32_t width, VecNode& tmp) {
+        if (v.isVec()) return v.asVec()->lane;
+        tmp = VecNode{};
+        std::fill(tmp.lane, tmp.lane + width, static_cast<float>(v.toDouble()));
+        return tmp.lane;
+    }
+
+    using VecFn = void (*)(const float*, const float*, float*);
+
+    static void lanewise(VecNode& r, Value a, Value b, VecFn f) {
+        VecNode ta, tb;
+        f(lanes(a, r.width, ta), lanes(b, r.width, tb), r.lane);
+    }
+
+    static Value lanewise(ExecContext& cx, Value a, Value b, VecFn f) {
+        VecNode& r = newVec(cx, std::max(widthOf(a), widthOf(b)));
+        lanewise(r, a, b, f);
+        return Value::fromVec(&r);
+    }
+
+    static Value smaller(Value a, Value b) { return numeric(a, b, [](auto x, auto y) { return x < y ? x : y; }); }
+    static Value larger(Value a, Value b) { return numeric(a, b, [](auto x, auto y) { return x > y ? x : y; }); }
+
+    static Value dot(Value a, Value b) {
+        if (!a.isVec() && !b.isVec()) return numeric(a, b, std::multiplies<>());
+        std::uint32_t w = std::max(widthOf(a), widthOf(b));
+        VecNode ta, tb;
+        return Value::fromDouble(vecKernels().dot(lanes(a, w, ta), lanes(b, w, tb)));
+    }
+
+    // Module string constants: one immutable copy per distinct literal,
+    // shared by every function version for the VM's lifetime.
+    const std::string* intern(const std::string& text) const {
+        std::lock_guard<std::mutex> lock(internMtx);
+        return &*interned.insert(text).first;
+    }
 
     static int toInt(const std::string& s) {
         // Accept decimal only (as per ICONST usage in original).
         return std::stoi(s);
     }
 
-    static bool mapHas(const std::unordered_map<std::string, int>& m, const std::string& k) {
-        return m.find(k) != m.end();
+    // CALL c / PARFOR b,c / SCHEDULE, EVERY, VEC, VCLAMP b hold
+    // comma-separated registers.
+    static int listSize(const std::string& list) {
+        return list.empty() ? 0 : 1 + static_cast<int>(std::count(list.begin(), list.end(), ','));
     }
 
-    int exec(const IRFunction& f, const std::vector<int>& args) {
-        // Integer registers and string registers
-        std::unordered_map<std::string, int> reg;
-        std::unordered_map<std::string, std::string> sreg;
+    static int argCount(const IRInst& ins) {
+        if (ins.op == IROp::SCHEDULE || ins.op == IROp::EVERY || ins.op == IROp::VEC || ins.op == IROp::VCLAMP)
+            return listSize(ins.b);
+        return ins.op == IROp::PARFOR ? listSize(ins.b) + listSize(ins.c) : listSize(ins.c);
+    }
 
-        // Precompute label -> pc map
-        std::unordered_map<std::string, std::size_t> labelToPc;
-        for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
-            if (f.code[pc].op == IROp::LABEL) {
-                labelToPc[f.code[pc].a] = pc;
+    static bool sameIR(const IRFunction& x, const IRFunction& y) {
+        if (x.params != y.params || x.code.size() != y.code.size()) return false;
+        for (std::size_t k = 0; k < x.code.size(); ++k) {
+            const IRInst& p = x.code[k];
+            const IRInst& q = y.code[k];
+            if (p.op != q.op || p.a != q.a || p.b != q.b || p.c != q.c) return false;
+        }
+        return true;
+    }
+
+    // Callers hold liveMtx.
+    void release(std::uint64_t e) {
+        auto it = liveEpochs.find(e);
+        if (it != liveEpochs.end() && --it->second == 0) liveEpochs.erase(it);
+    }
+
+    // Materialize a capsule function on first use. False if it is corrupt.
+    bool ensure(const LoadedFunc& fn) const {
+        if (fn.ready.load(std::memory_order_acquire)) return true;
+        std::lock_guard<std::mutex> lock(capsuleMtx);
+        if (fn.ready.load(std::memory_order_relaxed)) return true;
+        LoadedFunc& lf = const_cast<LoadedFunc&>(fn);   // owned mutably by live[]
+        std::string err = materialize(lf);
+        if (!err.empty()) {
+            std::cerr << "Corrupt capsule function #" << lf.index << ": " << err << '\n';
+            return false;
+        }
+        lf.ready.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // Validate capsule function lf.index and build its IR and decoded code.
+    // Returns an error message, empty on success.
+    std::string materialize(LoadedFunc& lf) const {
+        const Capsule& cap = *capsule;
+        if (!poolChecked && !cap.poolIntact()) return "string pool checksum mismatch";
+        poolChecked = true;
+        CapsuleFuncEntry e = cap.entry(lf.index);
+        std::uint64_t need = 4ull * e.nparams + sizeof(CapsuleIR) * std::uint64_t(e.nir)
+            + sizeof(DInstr) * std::uint64_t(e.ncode) + sizeof(Operand3) * std::uint64_t(e.nir)
+            + 4ull * e.nargs + 4ull * e.nstrings + 8ull * e.nconsts;
+        if (e.off > cap.bytes() || e.bytes > cap.bytes() - e.off || e.bytes != need)
+            return "bad function bounds";
+        if (fnv1a(cap.at(e.off), e.bytes) != e.checksum) return "checksum mismatch";
+
+        auto ir = std::make_unique<IRFunction>();
+        std::uint64_t off = e.off;
+        auto str = [&](std::string& out) {
+            std::uint32_t id = cap.read<std::uint32_t>(off);
+            off += 4;
+            return cap.str(id, out);
+        };
+        if (!cap.str(e.name, ir->name)) return "bad name";
+        ir->params.resize(e.nparams);
+        for (auto& p : ir->params) if (!str(p)) return "bad parameter";
+        ir->code.resize(e.nir);
+        for (auto& ins : ir->code) {
+            CapsuleIR r = cap.read<CapsuleIR>(off);
+            off += sizeof r;
+            ins.op = static_cast<IROp>(r.op);
+            ins.line = static_cast<int>(r.line);
+            if (irOpName(ins.op)[0] == '?' || !cap.str(r.a, ins.a) || !cap.str(r.b, ins.b)
+                || !cap.str(r.c, ins.c)) return "bad IR";
+        }
+        lf.code.resize(e.ncode);
+        std::memcpy(lf.code.data(), cap.at(off), e.ncode * sizeof(DInstr));
+        off += e.ncode * sizeof(DInstr);
+        lf.ops.resize(e.nir);
+        std::memcpy(lf.ops.data(), cap.at(off), e.nir * sizeof(Operand3));
+        off += e.nir * sizeof(Operand3);
+        lf.args.resize(e.nargs);
+        std::memcpy(lf.args.data(), cap.at(off), e.nargs * sizeof(std::uint32_t));
+        off += e.nargs * sizeof(std::uint32_t);
+        for (std::uint32_t k = 0; k < e.nstrings; ++k) {
+            std::string text;
+            if (!str(text)) return "bad string";
+            lf.strings.push_back(intern(text));
+        }
+        for (std::uint32_t k = 0; k < e.nconsts; ++k, off += 8)
+            lf.consts.push_back(Value::fromDouble(cap.read<double>(off)));
+        lf.nslots = e.nslots;
+        if (e.nparams > e.nslots) return "bad slot count";
+
+        // Operands must stay inside the frame, the pools and the module.
+        auto slotOk = [&](std::uint32_t v) { return v == NO_SLOT || v < e.nslots; };
+        for (std::size_t pc = 0; pc < e.nir; ++pc) {
+            const Operand3& o = lf.ops[pc];
+            bool ok;
+            switch (ir->code[pc].op) {
+            case IROp::SCONST: ok = slotOk(o.a) && o.b < e.nstrings && o.c == NO_SLOT; break;
+            case IROp::FCONST: ok = slotOk(o.a) && o.b < e.nconsts && o.c == NO_SLOT; break;
+            case IROp::PRINT:  ok = slotOk(o.a) && (o.b == NO_SLOT || o.b < e.nstrings) && o.c == NO_SLOT; break;
+            case IROp::CALL:
+            case IROp::PARFOR:
+                ok = (o.a == NO_FUNC || o.a < cap.funcCount()) && slotOk(o.b) && o.c <= e.nargs; break;
+            case IROp::SCHEDULE:
+            case IROp::EVERY:
+                ok = (o.a == NO_FUNC || o.a < cap.funcCount()) && o.b < e.nstrings && o.c <= e.nargs; break;
+            case IROp::VEC:
+            case IROp::VCLAMP:
+                ok = slotOk(o.a) && o.b == NO_SLOT && o.c <= e.nargs; break;
+            default: ok = slotOk(o.a) && slotOk(o.b) && slotOk(o.c); break;
             }
+            if (!ok) return "bad operand at IR " + std::to_string(pc);
         }
+        for (auto a : lf.args) if (a >= e.nslots) return "bad argument slot";
+        static const SuperopTable shapes = SuperopTable::defaults();
+        for (auto& d : lf.code) {
+            if (static_cast<unsigned>(d.op) >= VOP_COUNT || d.src >= e.nir) return "bad opcode";
+            const Operand3& o = lf.ops[d.src];
+            if (d.a != o.a || d.b != o.b || d.c != o.c) return "operands differ from IR";
+            if (d.target != UINT32_MAX && d.target > e.ncode) return "bad jump target";
+            std::size_t span = 1;
+            if (d.op == VOp::TAILCALL) span = 2;
+            for (auto& p : shapes.patterns) {
+                if (p.fused != d.op) continue;
+                span = p.seq.size();
+                for (std::size_t k = 0; k < span && d.src + k < e.nir; ++k)
+                    if (ir->code[d.src + k].op != p.seq[k]) return "fused op does not match IR";
+            }
+            if (d.src + span > e.nir) return "bad instruction span";
+            if (d.op == VOp::CALL || d.op == VOp::TAILCALL || d.op == VOp::PARFOR
+                || d.op == VOp::SCHEDULE || d.op == VOp::EVERY || d.op == VOp::VEC || d.op == VOp::VCLAMP) {
+                int least = 0, most = INT_MAX;
+                if (d.op == VOp::PARFOR) least = 2;
+                else if (d.op == VOp::SCHEDULE || d.op == VOp::EVERY) least = 1;
+                else if (d.op == VOp::VEC) { least = 1; most = static_cast<int>(VEC_LANES); }
+                else if (d.op == VOp::VCLAMP) least = most = 3;
+                if (d.imm < least || d.imm > most || d.c + std::uint64_t(d.imm) > e.nargs)
+                    return "bad argument list";
+            }
+        }
+        lf.own = std::move(ir);
+        lf.ir = lf.own.get();
+        markScratch(lf);
+        return {};
+    }
+
+    // Keep epoch e live for as long as the returned handle is.
+    std::shared_ptr<void> hold(std::uint64_t e) {
+        std::lock_guard<std::mutex> lock(liveMtx);
+        ++liveEpochs[e];
+        return std::shared_ptr<void>(nullptr, [this, e](void*) {
+            std::lock_guard<std::mutex> lock(liveMtx);
+            release(e);
+            reclaim();
+        });
+    }
+
+    void reclaim() {
+        std::uint64_t oldest = liveEpochs.empty() ? UINT64_MAX : liveEpochs.begin()->first;
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+            [&](const Retired& r) { return r.epoch <= oldest; }), retired.end());
+    }
 
-        // Bind arguments to parameters
-        for (std::size_t i = 0; i < f.params.size() && i < args.size(); ++i) {
-            reg[f.params[i]] = static_cast<int>(args[i]);
+    static bool matches(const IRFunction& f, std::size_t at, const SuperopPattern& p) {
+        if (at + p.seq.size() > f.code.size()) return false;
+        for (std::size_t k = 0; k < p.seq.size(); ++k)
+            if (f.code[at + k].op != p.seq[k]) return false;
+        return true;
+    }
+
+    static bool baseOp(IROp op, VOp& out) {
+        switch (op) {
+        case IROp::ICONST: out = VOp::ICONST; return true;
+        case IROp::FCONST: out = VOp::FCONST; return true;
+        case IROp::SCONST: out = VOp::SCONST; return true;
+        case IROp::LOAD:   out = VOp::LOAD;   return true;
+        case IROp::STORE:  out = VOp::STORE;  return true;
+        case IROp::ADD:    out = VOp::ADD;    return true;
+        case IROp::SUB:    out = VOp::SUB;    return true;
+        case IROp::MUL:    out = VOp::MUL;    return true;
+        case IROp::DIV:    out = VOp::DIV;    return true;
+        case IROp::CMP_EQ: out = VOp::CMP_EQ; return true;
+        case IROp::CMP_LE: out = VOp::CMP_LE; return true;
+        case IROp::CMP_LT: out = VOp::CMP_LT; return true;
+        case IROp::CMP_GT: out = VOp::CMP_GT; return true;
+        case IROp::CMP_GE: out = VOp::CMP_GE; return true;
+        case IROp::PRINT:  out = VOp::PRINT;  return true;
+        case IROp::CALL:   out = VOp::CALL;   return true;
+        case IROp::JMP:    out = VOp::JMP;    return true;
+        case IROp::JZ:     out = VOp::JZ;     return true;
+        case IROp::RET:    out = VOp::RET;    return true;
+        case IROp::PARFOR: out = VOp::PARFOR; return true;
+        case IROp::SCHEDULE: out = VOp::SCHEDULE; return true;
+        case IROp::EVERY:  out = VOp::EVERY;  return true;
+        case IROp::VEC:    out = VOp::VEC;    return true;
+        case IROp::VADD:   out = VOp::VADD;   return true;
+        case IROp::VMUL:   out = VOp::VMUL;   return true;
+        case IROp::VMIN:   out = VOp::VMIN;   return true;
+        case IROp::VMAX:   out = VOp::VMAX;   return true;
+        case IROp::VDOT:   out = VOp::VDOT;   return true;
+        case IROp::VCLAMP: out = VOp::VCLAMP; return true;
+        default:           return false;      // LABEL and unknown ops vanish
         }
+    }
 
-        int retVal = 0;
+    // Map every register / variable name in f to a frame slot and resolve
+    // operands, constants and callees.
+    void resolve(const IRFunction& f, LoadedFunc& lf,
+                 const std::unordered_map<std::string, std::uint32_t>& funcIndex) {
+        std::unordered_map<std::string, std::uint32_t> slots;
+        auto slot = [&](const std::string& name) {
+            if (name.empty()) return NO_SLOT;
+            auto it = slots.find(name);
+            if (it != slots.end()) return it->second;
+            std::uint32_t s = lf.nslots++;
+            slots[name] = s;
+            return s;
+        };
+        auto str = [&](const std::string& text) {
+            lf.strings.push_back(intern(text));
+            return static_cast<std::uint32_t>(lf.strings.size() - 1);
+        };
+        for (auto& p : f.params) slot(p);
 
-        for (std::size_t pc = 0; pc < f.code.size(); /* increment inside */) {
-            const IRInstr& ins = f.code[pc];
+        lf.ops.resize(f.code.size());
+        for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
+            const IRInst& ins = f.code[pc];
+            Operand3& o = lf.ops[pc];
             switch (ins.op) {
-            case IROp::ICONST: {
-                // reg[a] = int(b)
-                reg[ins.a] = toInt(ins.b);
-                ++pc;
+            case IROp::ICONST: o.a = slot(ins.a); break;
+            case IROp::SCONST: o.a = slot(ins.a); o.b = str(ins.b); break;
+            case IROp::FCONST:
+                o.a = slot(ins.a);
+                o.b = static_cast<std::uint32_t>(lf.consts.size());
+                lf.consts.push_back(Value::fromDouble(std::strtod(ins.b.c_str(), nullptr)));
+                break;
+            case IROp::LOAD: case IROp::STORE: o.a = slot(ins.a); o.b = slot(ins.b); break;
+            case IROp::ADD: case IROp::SUB: case IROp::MUL: case IROp::DIV:
+            case IROp::CMP_EQ: case IROp::CMP_LE: case IROp::CMP_LT:
+            case IROp::CMP_GT: case IROp::CMP_GE:
+            case IROp::VADD: case IROp::VMUL: case IROp::VMIN: case IROp::VMAX: case IROp::VDOT:
+                o.a = slot(ins.a); o.b = slot(ins.b); o.c = slot(ins.c); break;
+            case IROp::VEC:
+            case IROp::VCLAMP: {
+                o.a = slot(ins.a);
+                o.c = static_cast<std::uint32_t>(lf.args.size());
+                std::stringstream ss(ins.b);
+                for (std::string arg; std::getline(ss, arg, ',');) lf.args.push_back(slot(arg));
+            } break;
+            case IROp::JZ:  o.a = slot(ins.a); break;
+            case IROp::RET: o.a = slot(ins.a); break;
+            case IROp::CALL:
+            case IROp::PARFOR:
+            case IROp::SCHEDULE:
+            case IROp::EVERY: {
+                auto it = funcIndex.find(ins.a);
+                o.a = it == funcIndex.end() ? NO_FUNC : static_cast<std::uint32_t>(it->second);
+                o.c = static_cast<std::uint32_t>(lf.args.size());
+                std::string list = ins.c;
+                if (ins.op == IROp::CALL) o.b = slot(ins.b);
+                else if (ins.op != IROp::PARFOR) { o.b = str(ins.c); list = ins.b; }
+                else if (!ins.c.empty()) list = ins.b + "," + ins.c;
+                else list = ins.b;
+                std::stringstream ss(list);
+                for (std::string arg; std::getline(ss, arg, ',');) lf.args.push_back(slot(arg));
             } break;
+            default: break;
+            }
+        }
+        // PRINT names a register only if something else defines or reads it.
+        for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
+            const IRInst& ins = f.code[pc];
+            if (ins.op != IROp::PRINT) continue;
+            auto it = slots.find(ins.a);
+            if (it != slots.end()) lf.ops[pc].a = it->second;
+            else lf.ops[pc].b = str(ins.a);
+        }
+    }
 
-            case IROp::SCONST: {
-                // sreg[a] = b
-                sreg[ins.a] = ins.b;
+    // Vector temps that never leave their statement: written by one vector
+    // op, and read only by instructions that compute something new from
+    // them, never stored, returned or passed. Nothing else can still see
+    // the vector such a slot held, so the op that writes it again may
+    // overwrite that vector instead of allocating.
+    //
+    // Named variables get the same treatment (lf.owned): not a parameter,
+    // and read only through LOADs whose temp is itself kept in, and used up
+    // before the next label, branch or store to the name. STORE copies a
+    // vector into such a slot, into the one it holds when it can, so a
+    // store into one is not an escape either.
+    static void markScratch(LoadedFunc& lf) {
+        const IRFunction& f = *lf.ir;
+        auto each = [](const std::string& regs, auto fn) {
+            std::stringstream ss(regs);
+            for (std::string r; std::getline(ss, r, ',');) fn(r);
+        };
+        // every register or name an instruction reads
+        auto reads = [&](const IRInst& ins, auto fn) {
+            switch (ins.op) {
+            case IROp::ICONST: case IROp::FCONST: case IROp::SCONST: case IROp::JMP: case IROp::LABEL: break;
+            case IROp::PRINT: case IROp::RET: case IROp::JZ: fn(ins.a); break;
+            case IROp::LOAD: case IROp::STORE: fn(ins.b); break;
+            case IROp::CALL: each(ins.c, fn); break;
+            case IROp::PARFOR: each(ins.b, fn); each(ins.c, fn); break;
+            case IROp::SCHEDULE: case IROp::EVERY: case IROp::VEC: case IROp::VCLAMP: each(ins.b, fn); break;
+            default: fn(ins.b); fn(ins.c); break;
+            }
+        };
+        std::unordered_map<std::string, int> defs;
+        std::unordered_map<std::string, std::vector<std::size_t>> uses;
+        std::unordered_set<std::string> passed(f.params.begin(), f.params.end());   // seen by other code
+        std::unordered_set<std::string> owned;
+        for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
+            const IRInst& ins = f.code[pc];
+            reads(ins, [&](const std::string& r) { uses[r].push_back(pc); });
+            switch (ins.op) {
+            case IROp::PRINT: case IROp::JMP: case IROp::JZ: case IROp::LABEL: break;
+            case IROp::RET: passed.insert(ins.a); break;
+            case IROp::STORE: ++defs[ins.a]; owned.insert(ins.a); break;
+            case IROp::LOAD: ++defs[ins.a]; break;
+            case IROp::CALL: ++defs[ins.b]; each(ins.c, [&](const std::string& r) { passed.insert(r); }); break;
+            case IROp::PARFOR: each(ins.b, [&](const std::string& r) { passed.insert(r); }); each(ins.c, [&](const std::string& r) { passed.insert(r); }); break;
+            case IROp::SCHEDULE: case IROp::EVERY: each(ins.b, [&](const std::string& r) { passed.insert(r); }); break;
+            default: ++defs[ins.a]; break;
+            }
+        }
+        // A value escapes through a store unless the name it goes to is owned.
+        auto escapes = [&](const std::string& r) {
+            if (passed.count(r)) return true;
+            for (std::size_t pc : uses[r]) {
+                const IRInst& ins = f.code[pc];
+                if ((ins.op == IROp::STORE || ins.op == IROp::LOAD) && ins.b == r && !owned.count(ins.a)) return true;
+            }
+            return false;
+        };
+        // Whether the temp `t` loaded from `x` at `at` can still see x's
+        // vector after a store into x overwrote it.
+        auto outlives = [&](const std::string& t, const std::string& x, std::size_t at) {
+            if (defs[t] != 1) return true;
+            std::size_t last = at;
+            for (std::size_t pc : uses[t]) {
+                if (pc <= at) return true;
+                last = std::max(last, pc);
+            }
+            for (std::size_t pc = at + 1; pc < last; ++pc) {
+                const IRInst& ins = f.code[pc];
+                if (ins.op == IROp::LABEL || ins.op == IROp::JMP || ins.op == IROp::JZ) return true;
+                if (ins.op == IROp::STORE && ins.a == x) return true;
+            }
+            return false;
+        };
+        for (auto& r : passed) owned.erase(r);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
+                const IRInst& ins = f.code[pc];
+                if (ins.op == IROp::LOAD && owned.count(ins.b) && (escapes(ins.a) || outlives(ins.a, ins.b, pc))) {
+                    owned.erase(ins.b);
+                    changed = true;
+                }
+            }
+        }
+        lf.scratch.assign(lf.nslots, 0);
+        lf.owned.assign(lf.nslots, 0);
+        for (std::size_t pc = 0; pc < f.code.size(); ++pc) {
+            const IRInst& ins = f.code[pc];
+            bool makesVec = ins.op == IROp::VEC || ins.op == IROp::VADD || ins.op == IROp::VMUL
+                || ins.op == IROp::VMIN || ins.op == IROp::VMAX || ins.op == IROp::VCLAMP;
+            if (makesVec && defs[ins.a] == 1 && !escapes(ins.a) && lf.ops[pc].a < lf.nslots)
+                lf.scratch[lf.ops[pc].a] = 1;
+            if (ins.op == IROp::STORE && owned.count(ins.a) && lf.ops[pc].a < lf.nslots)
+                lf.owned[lf.ops[pc].a] = 1;
+        }
+    }
+
+    // Rank patterns by how many dispatches they would save in this module.
+    void rankSuperops(const IRModule& m) {
+        for (auto& p : superops.patterns) {
+            for (auto& f : m.funcs)
+                for (std::size_t pc = 0; pc < f.code.size(); ++pc)
+                    if (matches(f, pc, p)) ++p.staticCount;
+        }
+        for (auto& p : superops.patterns) if (p.score() > 0) ranked.push_back(&p);
+        std::stable_sort(ranked.begin(), ranked.end(),
+            [](const SuperopPattern* x, const SuperopPattern* y) { return x->score() > y->score(); });
+    }
+
+    void decode(LoadedFunc& lf, const std::unordered_map<std::string, std::uint32_t>& funcIndex) {
+        const IRFunction& f = *lf.ir;
+        resolve(f, lf, funcIndex);
+        markScratch(lf);
+        std::unordered_map<std::string, std::uint32_t> labelToPc;
+        std::vector<std::pair<std::size_t, std::string>> fixups;
+
+        for (std::size_t pc = 0; pc < f.code.size();) {
+            const IRInst& ins = f.code[pc];
+            if (ins.op == IROp::LABEL) {
+                labelToPc[ins.a] = static_cast<std::uint32_t>(lf.code.size());
                 ++pc;
-            } break;
+                continue;
+            }
+            DInstr d;
+            d.src = static_cast<std::uint32_t>(pc);
+            d.a = lf.ops[pc].a; d.b = lf.ops[pc].b; d.c = lf.ops[pc].c;
+            SuperopPattern* hit = nullptr;
+            if (superops.enabled)
+                for (auto* p : ranked) if (matches(f, pc, *p)) { hit = p; break; }
 
-            case IROp::LOAD: {
-                // reg[a] = reg[b]
-                reg[ins.a] = mapHas(reg, ins.b) ? reg[ins.b] : 0;
+            if (ins.op == IROp::CALL && pc + 1 < f.code.size()
+                && f.code[pc + 1].op == IROp::RET && f.code[pc + 1].a == ins.b) {
+                // CALL t; RET t  ->  reuse the current frame
+                d.op = VOp::TAILCALL;
+                d.imm = argCount(ins);
+                pc += 2;
+            } else if (hit) {
+                d.op = hit->fused;
+                for (std::size_t k = 0; k < hit->seq.size(); ++k) {
+                    const IRInst& part = f.code[pc + k];
+                    if (part.op == IROp::ICONST) d.imm = toInt(part.b);
+                    if (part.op == IROp::JZ) fixups.push_back({ lf.code.size(), part.b });
+                }
+                hit->fusedSites++;
+                pc += hit->seq.size();
+            } else {
+                if (!baseOp(ins.op, d.op)) { ++pc; continue; }
+                if (ins.op == IROp::ICONST) d.imm = toInt(ins.b);
+                if (ins.op == IROp::CALL || ins.op == IROp::PARFOR || ins.op == IROp::SCHEDULE
+                    || ins.op == IROp::EVERY || ins.op == IROp::VEC || ins.op == IROp::VCLAMP) d.imm = argCount(ins);
+                if (ins.op == IROp::PRINT && d.a == NO_SLOT) d.op = VOp::PRINT_STR;
+                if (ins.op == IROp::JMP) fixups.push_back({ lf.code.size(), ins.a });
+                if (ins.op == IROp::JZ)  fixups.push_back({ lf.code.size(), ins.b });
+                ++pc;
+            }
+            lf.code.push_back(d);
+        }
+        for (auto& fx : fixups) {
+            auto it = labelToPc.find(fx.second);
+            // Unknown labels jump past the end; run() reports them.
+            lf.code[fx.first].target = it == labelToPc.end()
+                ? UINT32_MAX : it->second;
+        }
+    }
+
+    // Run body(i, caps...) for i in [lo, hi]. Large ranges are split into
+    // chunks on the pool; each chunk buffers its output, which is written
+    // in chunk order afterwards so `say` keeps iteration order.
+    void parallelFor(std::size_t body, int lo, int hi, const std::vector<Value>& caps) {
+        if (hi < lo) return;
+        std::int64_t trip = static_cast<std::int64_t>(hi) - lo + 1;
+        auto runRange = [&](std::int64_t from, std::int64_t to) {
+            ExecContext cx;
+            std::vector<Value> args(1 + caps.size());
+            std::copy(caps.begin(), caps.end(), args.begin() + 1);
+            for (std::int64_t i = from; i <= to; ++i) {
+                args[0] = Value::fromInt(static_cast<int>(i));
+                if (start(cx, body, args.data(), args.size())) resume(cx, 0);
+            }
+            unpin(cx);
+        };
+        if (parWorkers <= 1 || trip < parMinTrip) {
+            runRange(lo, hi);
+            return;
+        }
+        std::call_once(poolOnce, [this] { pool = std::make_unique<WorkStealingPool>(parWorkers); });
+        std::size_t chunks = static_cast<std::size_t>(std::min<std::int64_t>(trip, pool->size() * 4));
+        std::int64_t per = (trip + chunks - 1) / chunks;
+        std::vector<std::string> out(chunks);
+        pool->parallelFor(chunks, [&](std::size_t k) {
+            std::int64_t from = lo + static_cast<std::int64_t>(k) * per;
+            std::int64_t to = std::min<std::int64_t>(hi, from + per - 1);
+            std::string* outer = outputCapture();
+            outputCapture() = &out[k];
+            runRange(from, to);
+            outputCapture() = outer;
+        });
+        for (auto& text : out) if (!text.empty()) emitText(text);
+    }
+
+    // Register fn(caps...) on the shared timer wheel, once after `ms` or
+    // every `ms`. The body runs in its own context on a timer worker and
+    // always enters the newest version of fn.
+    void addTimer(std::uint32_t fn, int ms, bool repeat, std::vector<Value> caps, const std::string& meta) {
+        CapsuleMeta m;
+        std::size_t bar = meta.find('|'), bar2 = meta.find('|', bar == std::string::npos ? bar : bar + 1);
+        m.name = meta.substr(0, bar);
+        if (bar2 != std::string::npos) {
+            m.origin = meta.substr(bar + 1, bar2 - bar - 1);
+            std::stringstream ss(meta.substr(bar2 + 1));
+            for (std::string q; std::getline(ss, q, ',');) m.qualifiers.push_back(q);
+        }
+        Task task{ [this, fn, caps = std::move(caps)] {
+            if (tracer)
+                if (TraceRing* tr = tracer->ring()) tr->emit(TraceType::Timer, fn, 0);
+            ExecContext cx;
+            if (start(cx, fn, caps.data(), caps.size())) resume(cx, 0);
+            unpin(cx);
+            OutputSink::instance().flushThread();  // one firing's lines stay together
+        } };
+        std::lock_guard<std::mutex> lock(timerMtx);
+        if (!timers) {
+            timers = std::make_unique<Scheduler>(static_cast<unsigned>(timerWorkers));
+            if (!timerStatsPath.empty()) {
+                bool json = timerStatsPath.size() >= 5 && timerStatsPath.compare(timerStatsPath.size() - 5, 5, ".json") == 0;
+                timers->dumpMetricsEvery(timerStatsMs, timerStatsPath, json);
+            }
+            timerThread = std::thread([s = timers.get()] { s->run(); });
+        }
+        if (repeat) timers->scheduleRepeating(task, std::max(ms, 1), m);
+        else timers->schedule(task, std::max(ms, 0), m);
+    }
+
+    // A captured value outlives the registering context: ropes, which live
+    // in that context's arena, are flattened into the VM's string table,
+    // and vectors are copied into the VM.
+    Value keep(Value v) const {
+        if (v.isVec()) {
+            std::lock_guard<std::mutex> lock(internMtx);
+            keptVecs.push_back(*v.asVec());
+            return Value::fromVec(&keptVecs.back());
+        }
+        if (!v.isRope() && !v.isStr()) return v;
+        std::string text;
+        appendText(text, v);
+        return Value::fromStr(intern(text));
+    }
+
+    // Push a zeroed frame for fn; `ret` is the caller slot for its result.
+    bool pushFrame(ExecContext& cx, const LoadedFunc& fn, std::uint32_t ret, std::uint64_t epoch) {
+        if (maxDepth && cx.frames.size() >= maxDepth) {
+            std::cerr << "Call depth limit (" << maxDepth << ") exceeded calling "
+                      << fn.ir->name << '\n';
+            return false;
+        }
+        std::uint32_t base = cx.top;
+        if (base + fn.nslots > cx.stack.size())
+            cx.stack.resize(std::max<std::size_t>(cx.stack.size() * 2, base + fn.nslots + 64));
+        std::fill(cx.stack.begin() + base, cx.stack.begin() + base + fn.nslots, Value{});
+        cx.top = base + fn.nslots;
+        ProfSlot* prof = profiler ? profiler->slot() : nullptr;
+        if (prof && cx.frames.size() == cx.frames.capacity()) {
+            prof->resizing = true;          // keep the SIGPROF handler off the old buffer
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        cx.frames.push_back({ &fn, 0, base, ret, static_cast<std::uint32_t>(epoch) });
+        if (prof) {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            prof->resizing = false;
+            if (profiler->exact) {
+                if (fn.index >= prof->calls.size()) prof->calls.resize(fn.index + 1);
+                ++prof->calls[fn.index];
+            }
+        }
+        if (tracer)
+            if (TraceRing* tr = tracer->ring()) tr->emit(TraceType::Enter, fn.index, 0);
+        return true;
+    }
+
+    RunState run(ExecContext& cx, std::uint32_t budget) {
+        const LoadedFunc* lf = nullptr;
+        Value* s = nullptr;
+        std::size_t pc = 0;
+        // --profile: publish cx / fn / pc to this thread's sampling slot
+        ProfSlot* prof = profiler ? profiler->slot() : nullptr;
+        const bool exact = prof && profiler->exact;
+        struct ProfRestore {
+            ProfSlot* slot; const ExecContext* cx;
+            ~ProfRestore() { if (slot) slot->cx = cx; }
+        } profRestore{ prof, prof ? prof->cx : nullptr };
+        if (prof) prof->cx = &cx;
+        TraceRing* tr = tracer ? tracer->ring() : nullptr;
+        auto enter = [&]() {
+            const Frame& fr = cx.frames.back();
+            lf = fr.fn;
+            s = cx.stack.data() + fr.base;
+            pc = fr.pc;
+            if (fr.base < cx.dirtyFrom) cx.dirtyFrom = fr.base;
+            if (prof) {
+                prof->fn = lf;
+                prof->pc = static_cast<std::uint32_t>(pc);
+                if (exact && lf->index >= prof->fnOps.size()) prof->fnOps.resize(lf->index + 1);
+            }
+        };
+        // Pop the current frame, delivering `v` to the caller.
+        // Returns true when the outermost frame has returned.
+        auto leave = [&](Value v) {
+            Frame fr = cx.frames.back();
+            cx.frames.pop_back();
+            cx.top = fr.base;
+            if (tr) tr->emit(TraceType::Exit, fr.fn->index, 0);
+            if (cx.frames.empty()) { cx.result = v.toInt(); return true; }
+            if (fr.ret != NO_SLOT) cx.stack[fr.ret] = v;
+            enter();
+            return false;
+        };
+        auto jump = [&](const DInstr& d, const std::string& label) {
+            if (d.target == UINT32_MAX) {
+                std::cerr << "Unknown label: " << label << '\n';
+                return false;
+            }
+            pc = d.target;
+            if (tr) tr->emit(TraceType::Branch, lf->index, d.target);
+            return true;
+        };
+        auto irOf = [&](const DInstr& d) -> const IRInst& { return lf->ir->code[d.src]; };
+        // Where a vector op puts its result: back into the vector a scratch
+        // temp got the last time this instruction ran, unless a checkpoint
+        // still shares the arena; otherwise a new arena node.
+        auto vecDst = [&](const DInstr& d, std::uint32_t width) -> VecNode& {
+            Value old = s[d.a];
+            if (lf->scratch[d.a] && old.isVec() && cx.strings.use_count() == 1) {
+                VecNode& r = const_cast<VecNode&>(*old.asVec());
+                r.width = width;
+                return r;
+            }
+            return newVec(cx, width);
+        };
+        // s[a] = v. A vector stored into an owned name is copied, into the
+        // vector the name already holds unless a checkpoint shares it.
+        auto store = [&](std::uint32_t a, Value v) {
+            if (v.isVec() && lf->owned[a]) {
+                Value old = s[a];
+                VecNode& r = old.isVec() && cx.strings.use_count() == 1 ? const_cast<VecNode&>(*old.asVec()) : newVec(cx, 0);
+                if (&r != v.asVec()) r = *v.asVec();
+                v = Value::fromVec(&r);
+            }
+            s[a] = v;
+        };
+        // Preemption point, taken at back-edges and calls. No Value is held
+        // outside the stack here, so it is also where dead text is freed,
+        // and where a sampling profile learns the pc.
+        std::uint32_t fuel = budget;
+        auto spend = [&]() {
+            if (prof) prof->pc = static_cast<std::uint32_t>(pc);
+            if (cx.strings && cx.strings->size() >= cx.strings->collectAt) collectText(cx);
+            if (!budget || --fuel) return false;
+            cx.frames.back().pc = static_cast<std::uint32_t>(pc);
+            return true;
+        };
+        enter();
+
+        for (;;) {
+            if (pc >= lf->code.size()) {
+                // Fell off the end: implicit `ret 0`.
+                if (leave(Value{})) return RunState::Done;
+                continue;
+            }
+            const DInstr& d = lf->code[pc];
+            if (exact) {
+                prof->pc = static_cast<std::uint32_t>(pc);
+                ++prof->ops[static_cast<unsigned>(d.op)];
+                ++prof->fnOps[lf->index];
+            }
+            switch (d.op) {
+            case VOp::ICONST: {
+                // s[a] = int(b), parsed at load time
+                s[d.a] = Value::fromInt(d.imm);
                 ++pc;
             } break;
 
-            case IROp::STORE: {
-                // Alias of LOAD semantics (kept for clarity)
-                reg[ins.a] = mapHas(reg, ins.b) ? reg[ins.b] : 0;
+            case VOp::FCONST: {
+                s[d.a] = lf->consts[d.b];
                 ++pc;
             } break;
 
-            case IROp::ADD: {
-                reg[ins.a] = (mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    + (mapHas(reg, ins.c) ? reg[ins.c] : 0);
+            case VOp::SCONST: {
+                s[d.a] = Value::fromStr(lf->strings[d.b]);
                 ++pc;
             } break;
 
-            case IROp::SUB: {
-                reg[ins.a] = (mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    - (mapHas(reg, ins.c) ? reg[ins.c] : 0);
+            case VOp::LOAD: {
+                s[d.a] = s[d.b];
                 ++pc;
             } break;
 
-            case IROp::MUL: {
-                reg[ins.a] = (mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    * (mapHas(reg, ins.c) ? reg[ins.c] : 0);
+            case VOp::STORE: {
+                store(d.a, s[d.b]);
                 ++pc;
             } break;
 
-            case IROp::DIV: {
-                int rhs = mapHas(reg, ins.c) ? reg[ins.c] : 0;
-                if (rhs == 0) {
+            case VOp::ADD: { s[d.a] = add(cx, s[d.b], s[d.c]); ++pc; } break;
+            case VOp::SUB: { s[d.a] = numeric(s[d.b], s[d.c], std::minus<>()); ++pc; } break;
+            case VOp::MUL: { s[d.a] = mul(cx, s[d.b], s[d.c]); ++pc; } break;
+
+            case VOp::DIV: {
+                Value lhs = s[d.b], rhs = s[d.c];
+                if (!lhs.isDouble() && !rhs.isDouble() && rhs.toInt() == 0) {
                     std::cerr << "Division by zero\n";
-                    return 0;
+                    if (leave(Value{})) return RunState::Done;
+                    break;
                 }
-                int lhs = mapHas(reg, ins.b) ? reg[ins.b] : 0;
-                reg[ins.a] = lhs / rhs;
+                s[d.a] = numeric(lhs, rhs, std::divides<>());
                 ++pc;
             } break;
 
-            case IROp::CMP_EQ: {
-                reg[ins.a] = ((mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    == (mapHas(reg, ins.c) ? reg[ins.c] : 0)) ? 1 : 0;
+            case VOp::CMP_EQ: { s[d.a] = compare(s[d.b], s[d.c], std::equal_to<>()); ++pc; } break;
+            case VOp::CMP_LE: { s[d.a] = compare(s[d.b], s[d.c], std::less_equal<>()); ++pc; } break;
+            case VOp::CMP_LT: { s[d.a] = compare(s[d.b], s[d.c], std::less<>()); ++pc; } break;
+            case VOp::CMP_GT: { s[d.a] = compare(s[d.b], s[d.c], std::greater<>()); ++pc; } break;
+            case VOp::CMP_GE: { s[d.a] = compare(s[d.b], s[d.c], std::greater_equal<>()); ++pc; } break;
+
+            case VOp::PRINT: {
+                if (tr) tr->emit(TraceType::Say, lf->index, static_cast<std::uint32_t>(pc));
+                emitText(show(s[d.a]) + "\n");
                 ++pc;
             } break;
 
-            case IROp::CMP_LE: {
-                reg[ins.a] = ((mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    <= (mapHas(reg, ins.c) ? reg[ins.c] : 0)) ? 1 : 0;
+            case VOp::PRINT_STR: {
+                if (tr) tr->emit(TraceType::Say, lf->index, static_cast<std::uint32_t>(pc));
+                emitText(*lf->strings[d.b] + "\n");
                 ++pc;
             } break;
 
-            case IROp::CMP_LT: {
-                reg[ins.a] = ((mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    < (mapHas(reg, ins.c) ? reg[ins.c] : 0)) ? 1 : 0;
+            case VOp::CALL:
+            case VOp::TAILCALL: {
+                if (d.a == NO_FUNC) {
+                    std::cerr << "Unknown function: " << irOf(d).a << '\n';
+                    if (d.b != NO_SLOT) s[d.b] = Value{};
+                    if (d.op == VOp::TAILCALL) { if (leave(Value{})) return RunState::Done; }
+                    else ++pc;
+                    break;
+                }
+                const FuncTable* t = table.load(std::memory_order_acquire);
+                const LoadedFunc& callee = *t->funcs[d.a];
+                if (!ensure(callee)) {
+                    cx.frames.clear();
+                    cx.top = 0;
+                    cx.result = 0;
+                    return RunState::Error;
+                }
+                const std::uint32_t* argSlots = lf->args.data() + d.c;
+                std::size_t np = std::min<std::size_t>(callee.ir->params.size(), d.imm);
+                std::uint32_t callerBase = cx.frames.back().base;
+                std::uint32_t ret;
+                Value staged[16];
+                std::vector<Value> spill;
+                Value* av = staged;
+                if (d.op == VOp::TAILCALL) {
+                    // Args may overlap the frame being replaced: stage them first.
+                    if (np > 16) { spill.resize(np); av = spill.data(); }
+                    for (std::size_t k = 0; k < np; ++k) av[k] = s[argSlots[k]];
+                    Frame fr = cx.frames.back();
+                    cx.frames.pop_back();
+                    cx.top = fr.base;
+                    if (tr) tr->emit(TraceType::Exit, fr.fn->index, 0);
+                    ret = fr.ret;  // the result goes straight to our caller
+                } else {
+                    cx.frames.back().pc = static_cast<std::uint32_t>(pc + 1);
+                    ret = d.b == NO_SLOT ? NO_SLOT : callerBase + d.b;
+                }
+                if (!pushFrame(cx, callee, ret, t->epoch)) {
+                    cx.frames.clear();
+                    cx.top = 0;
+                    cx.result = 0;
+                    return RunState::Error;
+                }
+                Value* cs = cx.stack.data() + cx.frames.back().base;
+                if (d.op == VOp::TAILCALL)
+                    for (std::size_t k = 0; k < np; ++k) cs[k] = av[k];
+                else
+                    for (std::size_t k = 0; k < np; ++k) cs[k] = cx.stack[callerBase + argSlots[k]];
+                enter();
+                if (spend()) return RunState::Yielded;
+            } break;
+
+            case VOp::PARFOR: {
+                if (d.a == NO_FUNC) {
+                    std::cerr << "Unknown function: " << irOf(d).a << '\n';
+                    ++pc;
+                    break;
+                }
+                const std::uint32_t* as = lf->args.data() + d.c;
+                std::vector<Value> caps;
+                for (int k = 2; k < d.imm; ++k) caps.push_back(s[as[k]]);
+                parallelFor(d.a, s[as[0]].toInt(), s[as[1]].toInt(), caps);
                 ++pc;
+                if (spend()) return RunState::Yielded;
             } break;
 
-            case IROp::CMP_GT: {
-                reg[ins.a] = ((mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    > (mapHas(reg, ins.c) ? reg[ins.c] : 0)) ? 1 : 0;
+            case VOp::SCHEDULE:
+            case VOp::EVERY: {
+                if (d.a == NO_FUNC) {
+                    std::cerr << "Unknown function: " << irOf(d).a << '\n';
+                    ++pc;
+                    break;
+                }
+                const std::uint32_t* as = lf->args.data() + d.c;
+                std::vector<Value> caps;
+                for (int k = 1; k < d.imm; ++k) caps.push_back(keep(s[as[k]]));
+                addTimer(d.a, s[as[0]].toInt(), d.op == VOp::EVERY, std::move(caps), *lf->strings[d.b]);
                 ++pc;
             } break;
 
-            case IROp::CMP_GE: {
-                reg[ins.a] = ((mapHas(reg, ins.b) ? reg[ins.b] : 0)
-                    >= (mapHas(reg, ins.c) ? reg[ins.c] : 0)) ? 1 : 0;
+            case VOp::VEC: {
+                const std::uint32_t* as = lf->args.data() + d.c;
+                VecNode& r = vecDst(d, static_cast<std::uint32_t>(d.imm));
+                for (std::uint32_t k = 0; k < VEC_LANES; ++k)
+                    r.lane[k] = k < r.width ? static_cast<float>(s[as[k]].toDouble()) : 0.0f;
+                s[d.a] = Value::fromVec(&r);
                 ++pc;
             } break;
 
-            case IROp::PRINT: {
-                // Prefer int reg, then string reg, else raw operand
-                if (mapHas(reg, ins.a)) {
-                    std::cout << reg[ins.a] << std::endl;
-                }
-                else {
-                    auto sit = sreg.find(ins.a);
-                    if (sit != sreg.end()) {
-                        std::cout << sit->second << std::endl;
-                    }
-                    else {
-                        std::cout << ins.a << std::endl;
-                    }
+            case VOp::VADD:
+            case VOp::VMUL:
+            case VOp::VMIN:
+            case VOp::VMAX: {
+                Value a = s[d.b], b = s[d.c];
+                if ((a.isVec() || b.isVec()) && !a.isText() && !b.isText()) {
+                    const VecKernels& k = vecKernels();
+                    VecNode& r = vecDst(d, std::max(widthOf(a), widthOf(b)));
+                    lanewise(r, a, b, d.op == VOp::VADD ? k.add : d.op == VOp::VMUL ? k.mul
+                                      : d.op == VOp::VMIN ? k.min : k.max);
+                    s[d.a] = Value::fromVec(&r);
+                } else if (d.op == VOp::VADD) {
+                    s[d.a] = add(cx, a, b);
+                } else if (d.op == VOp::VMUL) {
+                    s[d.a] = mul(cx, a, b);
+                } else {
+                    s[d.a] = d.op == VOp::VMIN ? smaller(a, b) : larger(a, b);
                 }
                 ++pc;
             } break;
 
-            case IROp::CALL: {
-                // Simple: call function in a; store result in b if not empty
-                int result = call(ins.a);
-                if (!ins.b.empty()) reg[ins.b] = result;
+            case VOp::VDOT: { s[d.a] = dot(s[d.b], s[d.c]); ++pc; } break;
+
+            case VOp::VCLAMP: {
+                const std::uint32_t* as = lf->args.data() + d.c;
+                Value v = s[as[0]], lo = s[as[1]], hi = s[as[2]];
+                if (v.isVec() || lo.isVec() || hi.isVec()) {
+                    VecNode& r = vecDst(d, std::max({ widthOf(v), widthOf(lo), widthOf(hi) }));
+                    VecNode tv, tl, th;
+                    vecKernels().clamp(lanes(v, r.width, tv), lanes(lo, r.width, tl), lanes(hi, r.width, th), r.lane);
+                    s[d.a] = Value::fromVec(&r);
+                } else {
+                    s[d.a] = smaller(larger(v, lo), hi);
+                }
                 ++pc;
             } break;
 
-            case IROp::JMP: {
-                auto it = labelToPc.find(ins.a);
-                if (it == labelToPc.end()) {
-                    std::cerr << "Unknown label: " << ins.a << '\n';
-                    return 0;
+            case VOp::JMP: {
+                std::size_t from = pc;
+                if (!jump(d, irOf(d).a)) { if (leave(Value{})) return RunState::Done; }
+                else if (pc <= from && spend()) return RunState::Yielded;
+            } break;
+
+            case VOp::JZ: {
+                if (!s[d.a].truthy()) {
+                    std::size_t from = pc;
+                    if (!jump(d, irOf(d).b)) { if (leave(Value{})) return RunState::Done; }
+                    else if (pc <= from && spend()) return RunState::Yielded;
+                }
+                else {
+                    ++pc;
                 }
-                pc = it->second;
             } break;
 
-            case IROp::JZ: {
-                int cond = mapHas(reg, ins.a) ? reg[ins.a] : 0;
-                if (!cond) {
-                    auto it = labelToPc.find(ins.b);
-                    if (it == labelToPc.end()) {
-                        std::cerr << "Unknown label: " << ins.b << '\n';
-                        return 0;
-                    }
-                    pc = it->second;
+            case VOp::RET: {
+                Value v = d.a != NO_SLOT ? s[d.a] : Value{};
+                if (leave(v)) return RunState::Done;
+            } break;
+
+            // ---- fused handlers: same effects as the sequence, one dispatch ----
+
+            case VOp::LOOP_TEST: {
+                const Operand3* o = &lf->ops[d.src];
+                s[o[0].a] = s[o[0].b];
+                s[o[1].a] = compare(s[o[1].b], s[o[1].c], std::less_equal<>());
+                if (!s[o[2].a].truthy()) {
+                    if (!jump(d, lf->ir->code[d.src + 2].b)) { if (leave(Value{})) return RunState::Done; }
                 }
                 else {
                     ++pc;
                 }
             } break;
 
-            case IROp::LABEL: {
-                // No-op at runtime (labels pre-indexed)
+            case VOp::ADD_IMM_STORE: {
+                const Operand3* o = &lf->ops[d.src];
+                s[o[0].a] = Value::fromInt(d.imm);
+                s[o[1].a] = add(cx, s[o[1].b], s[o[1].c]);
+                store(o[2].a, s[o[2].b]);
                 ++pc;
             } break;
 
-            case IROp::RET: {
-                if (!ins.a.empty() && mapHas(reg, ins.a)) {
-                    retVal = reg[ins.a];
+            case VOp::TEST_EQ_IMM: {
+                const Operand3* o = &lf->ops[d.src];
+                s[o[0].a] = s[o[0].b];
+                s[o[1].a] = Value::fromInt(d.imm);
+                s[o[2].a] = compare(s[o[2].b], s[o[2].c], std::equal_to<>());
+                if (!s[o[3].a].truthy()) {
+                    if (!jump(d, lf->ir->code[d.src + 3].b)) { if (leave(Value{})) return RunState::Done; }
+                }
+                else {
+                    ++pc;
                 }
-                return retVal;
+            } break;
+
+            case VOp::CONST_STORE: {
+                const Operand3* o = &lf->ops[d.src];
+                s[o[0].a] = Value::fromInt(d.imm);
+                s[o[1].a] = s[o[1].b];
+                ++pc;
+            } break;
+
+            case VOp::LOAD_LOAD_ADD: {
+                const Operand3* o = &lf->ops[d.src];
+                s[o[0].a] = s[o[0].b];
+                s[o[1].a] = s[o[1].b];
+                s[o[2].a] = add(cx, s[o[2].b], s[o[2].c]);
+                ++pc;
             } break;
 
             default: {
@@ -247,7 +2668,159 @@ private:
             } break;
             }
         }
-        return retVal;
+    }
+};
+
+// -----------------------------
+// Fibers:
+// -----------------------------
+// A fiber is one capsule invocation with its own ExecContext. Workers run a
+// fiber for `budget` back-edges/calls, then requeue it, so a long-running
+// capsule cannot starve the others. Each worker owns a deque; idle workers
+// steal from the back of their neighbours'.
+struct Fiber {
+    std::uint64_t id = 0;
+    ExecContext cx;
+    RunState state = RunState::Yielded;
+};
+
+class FiberPool {
+public:
+    FiberPool(VM& vm, std::size_t workers, std::uint32_t budget = 1000)
+        : vm(vm), budget(budget ? budget : 1), queues(workers ? workers : 1) {
+        for (std::size_t w = 0; w < queues.size(); ++w)
+            threads.emplace_back([this, w] { work(w); });
+    }
+
+    ~FiberPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    // Start `name` as a new fiber; returns its id (0 if it could not start).
+    std::uint64_t spawn(const std::string& name, const std::vector<int>& args = {}) {
+        auto f = std::make_unique<Fiber>();
+        if (!vm.start(f->cx, name, args)) {
+            vm.unpin(f->cx);
+            return 0;
+        }
+        Fiber* raw = f.get();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            raw->id = fibers.size() + 1;
+            fibers.push_back(std::move(f));
+            ++live;
+        }
+        push(next++ % queues.size(), raw);
+        return raw->id;
+    }
+
+    // Block until every spawned fiber has finished.
+    void wait() {
+        std::unique_lock<std::mutex> lock(mtx);
+        doneCv.wait(lock, [this] { return live == 0; });
+    }
+
+    // As wait(), but give up after `ms`; returns true once all are finished.
+    bool waitFor(int ms) {
+        std::unique_lock<std::mutex> lock(mtx);
+        return doneCv.wait_for(lock, std::chrono::milliseconds(ms), [this] { return live == 0; });
+    }
+
+    int result(std::uint64_t id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return id && id <= fibers.size() ? fibers[id - 1]->cx.result : 0;
+    }
+
+    // Finished fibers that stopped on an error.
+    std::size_t failed() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return static_cast<std::size_t>(std::count_if(fibers.begin(), fibers.end(),
+            [](const std::unique_ptr<Fiber>& f) { return f->state == RunState::Error; }));
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<Fiber*> q;
+    };
+
+    VM& vm;
+    std::uint32_t budget;
+    std::vector<Queue> queues;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Fiber>> fibers;
+    std::mutex mtx;
+    std::condition_variable cv, doneCv;
+    std::atomic<std::size_t> queued{ 0 };
+    std::atomic<std::size_t> next{ 0 };
+    std::size_t live = 0;
+    bool stopping = false;
+
+    void push(std::size_t w, Fiber* f) {
+        {
+            std::lock_guard<std::mutex> lock(queues[w].m);
+            queues[w].q.push_back(f);
+        }
+        if (queued.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_all();
+        }
+    }
+
+    Fiber* take(std::size_t w) {
+        {
+            // Own queue: FIFO, so yielded fibers round-robin.
+            std::lock_guard<std::mutex> lock(queues[w].m);
+            if (!queues[w].q.empty()) {
+                Fiber* f = queues[w].q.front();
+                queues[w].q.pop_front();
+                queued.fetch_sub(1);
+                return f;
+            }
+        }
+        for (std::size_t k = 1; k < queues.size(); ++k) {
+            Queue& victim = queues[(w + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.m);
+            if (!victim.q.empty()) {
+                Fiber* f = victim.q.back();
+                victim.q.pop_back();
+                queued.fetch_sub(1);
+                return f;
+            }
+        }
+        return nullptr;
+    }
+
+    void work(std::size_t w) {
+        for (;;) {
+            Fiber* f = take(w);
+            if (!f) {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || queued.load() > 0; });
+                if (stopping && queued.load() == 0) return;
+                continue;
+            }
+            f->state = vm.resume(f->cx, budget);
+            // The fiber may resume on another worker: publish its output first.
+            OutputSink::instance().flushThread();
+            if (f->state == RunState::Yielded) {
+                vm.repin(f->cx);
+                push(w, f);
+                continue;
+            }
+            vm.unpin(f->cx);
+            // Finished: keep the result, drop the frame stack.
+            f->cx.stack = std::vector<Value>();
+            f->cx.strings.reset();
+            f->cx.frames = std::vector<Frame>();
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--live == 0) doneCv.notify_all();
+        }
     }
 };
 
@@ -271,8 +2844,10 @@ int main() {
     IRModule m;
     m.funcs.push_back(makeHello());
     VM vm(m);
-    int r = vm.call("hello");
+    int r = 0;
+    vm.call("hello", {}, &r);
     std::cout << "Return: " << r << std::endl;
+    vm.dumpSuperops(std::cout);
     return 0;
 }
 #endif
@@ -0,0 +1,117 @@
+// Submit-latency benchmark and multi-producer check for the simple
+// scheduler in Scheduler.hpp.
+//
+//   cmajor_sched_bench [--tasks=N] [--producers=P] [--reps=R]
+//
+// The checks run first; the exit status is 1 if a full queue accepted a
+// submit, a queue with room refused one, or any accepted task ran other
+// than exactly once. The benchmark then has one thread submit N tasks into
+// an empty queue and run() drain them, and reports ns per task (min and
+// median over R reps).
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using simple_sched::Scheduler;
+
+static double nowNs(){
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// `producers` threads race to submit into a queue of `capacity` (a power of
+// two) with no consumer: exactly `capacity` submits succeed and the rest
+// return false. run() then runs each accepted task once and nothing else.
+static bool checkFull(std::size_t capacity, int producers, std::size_t each){
+    Scheduler s(capacity);
+    const std::size_t total=producers*each;
+    std::unique_ptr<std::atomic<int>[]> ran(new std::atomic<int>[total]());
+    std::unique_ptr<char[]> accepted(new char[total]());
+    const std::uint32_t name=s.intern("fill");
+    std::vector<std::thread> ts;
+    for (int p=0;p<producers;p++) ts.emplace_back([&, p]{
+        for (std::size_t k=0;k<each;k++){
+            std::size_t id=p*each+k;
+            accepted[id]=s.submit(name, [&ran, id]{ ran[id].fetch_add(1); });
+        }
+    });
+    for (auto& t : ts) t.join();
+    std::size_t taken=std::count(accepted.get(), accepted.get()+total, 1);
+    bool ok=true;
+    if (taken!=capacity){
+        std::cerr<<"full queue: "<<taken<<" of "<<total<<" submits accepted, capacity "<<capacity<<"\n"; ok=false;
+    }
+    s.run();
+    std::size_t wrong=0;
+    for (std::size_t id=0;id<total;id++) if (ran[id].load()!=accepted[id]) ++wrong;
+    if (wrong){ std::cerr<<"full queue: "<<wrong<<" task(s) ran a wrong number of times\n"; ok=false; }
+    if (!s.submit(name, []{})){ std::cerr<<"drained queue refused a submit\n"; ok=false; }
+    return ok;
+}
+
+// `producers` threads each submit `each` tasks into a small queue, retrying
+// while it is full, as two consumers keep calling run(). Every task must
+// run exactly once.
+static bool checkConcurrent(std::size_t capacity, int producers, std::size_t each){
+    Scheduler s(capacity);
+    const std::size_t total=producers*each;
+    std::unique_ptr<std::atomic<int>[]> ran(new std::atomic<int>[total]());
+    std::atomic<std::size_t> done{0};
+    const std::uint32_t name=s.intern("race");
+    std::vector<std::thread> ts;
+    for (int c=0;c<2;c++) ts.emplace_back([&]{ while (done.load()<total){ s.run(); std::this_thread::yield(); } });
+    for (int p=0;p<producers;p++) ts.emplace_back([&, p]{
+        for (std::size_t k=0;k<each;k++){
+            std::size_t id=p*each+k;
+            while (!s.submit(name, [&ran, &done, id]{ ran[id].fetch_add(1); done.fetch_add(1); }))
+                std::this_thread::yield();
+        }
+    });
+    for (auto& t : ts) t.join();
+    std::size_t wrong=0;
+    for (std::size_t id=0;id<total;id++) if (ran[id].load()!=1) ++wrong;
+    if (wrong){ std::cerr<<"concurrent: "<<wrong<<" of "<<total<<" task(s) did not run exactly once\n"; return false; }
+    return true;
+}
+
+int main(int argc, char** argv){
+    int tasks=1<<16, producers=4, reps=9;
+    for (int i=1;i<argc;i++){
+        std::string a=argv[i];
+        if (a.rfind("--tasks=",0)==0) tasks=std::max(1, std::stoi(a.substr(8)));
+        else if (a.rfind("--producers=",0)==0) producers=std::max(1, std::stoi(a.substr(12)));
+        else if (a.rfind("--reps=",0)==0) reps=std::max(1, std::stoi(a.substr(7)));
+        else { std::cerr<<"usage: cmajor_sched_bench [--tasks=N] [--producers=P] [--reps=R]\n"; return 1; }
+    }
+
+    bool ok=checkFull(1024, producers, 1024) && checkConcurrent(256, producers, tasks/producers+1);
+    std::cout<<"check: "<<(ok ? "ok" : "FAILED")<<" ("<<producers<<" producers)\n";
+    if (!ok) return 1;
+
+    // One producer, then one consumer; the queue never fills.
+    std::vector<double> submitNs, runNs;
+    long sink=0;
+    for (int r=0;r<=reps;r++){       // rep 0 is the warm-up
+        Scheduler s(tasks);
+        const std::uint32_t name=s.intern("bench");
+        double t0=nowNs();
+        for (int k=0;k<tasks;k++) s.submit(name, [&sink]{ ++sink; });
+        double t1=nowNs();
+        s.run();
+        double t2=nowNs();
+        if (r){ submitNs.push_back((t1-t0)/tasks); runNs.push_back((t2-t1)/tasks); }
+    }
+    auto report=[&](const char* what, std::vector<double> v){
+        std::sort(v.begin(), v.end());
+        std::cout<<what<<": min "<<v.front()<<" ns, median "<<v[v.size()/2]<<" ns per task\n";
+    };
+    report("submit", submitNs);
+    report("run", runNs);
+    return sink==static_cast<long>(tasks)*(reps+1) ? 0 : 1;
+}
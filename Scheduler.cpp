@@ -1,7 +1,7 @@
 #include <iostream>
-#include <queue>
+#include <algorithm>
+#include <deque>
 #include <vector>
-#include <set>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -9,7 +9,18 @@
 #include <chrono>
 #include <functional>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include "MutationLog.hpp"
+#include "Histogram.hpp"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 struct CapsuleMeta {
     std::string name;
@@ -34,11 +45,17 @@ TimePoint add_ms(const TimePoint& tp, int64_t delta) {
     return TimePoint{ tp.ticks_ms + delta };
 }
 
-struct MutationEvent {
-    uint64_t taskId;
-    std::string type;
-    TimePoint at;
-};
+// Same clock as now_ms(), for the latency histograms.
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Ticks are steady_clock milliseconds, so a tick maps back onto that clock
+// directly (not onto the system epoch).
+std::chrono::steady_clock::time_point steady_at(int64_t ticks_ms) {
+    return std::chrono::steady_clock::time_point(std::chrono::milliseconds(ticks_ms));
+}
 
 struct ScheduledTask {
     TimePoint time;
@@ -49,22 +66,289 @@ struct ScheduledTask {
     CapsuleMeta meta;
 };
 
-struct Earlier {
-    bool operator()(const ScheduledTask& a, const ScheduledTask& b) const {
-        return a.time.ticks_ms > b.time.ticks_ms; // min-heap
+// Per-capsule timing, keyed by CapsuleMeta::name. All values in ns except
+// depth, which counts jobs queued on the workers when the timer was handed
+// over.
+struct CapsuleStats {
+    HdrHistogram lag;       // due -> started on a worker
+    HdrHistogram run;       // task run time
+    HdrHistogram depth;
+};
+
+struct CapsuleMetrics {
+    std::string name;
+    HistogramSnapshot lag;
+    HistogramSnapshot run;
+    HistogramSnapshot depth;
+};
+
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The owning worker pushes and pops
+// at the bottom; any thread may steal from the top.
+template <typename T>
+class WorkDeque {
+    struct Ring {
+        explicit Ring(int64_t cap) : cap(cap), slots(new std::atomic<T*>[cap]) {}
+        int64_t cap;
+        std::unique_ptr<std::atomic<T*>[]> slots;
+        T* get(int64_t i) const { return slots[i & (cap - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, T* x) { slots[i & (cap - 1)].store(x, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> _top{ 0 };
+    std::atomic<int64_t> _bottom{ 0 };
+    std::atomic<Ring*> _ring;
+    std::vector<std::unique_ptr<Ring>> _rings;   // outgrown rings stay valid for late thieves
+
+public:
+    WorkDeque() {
+        _rings.emplace_back(new Ring(64));
+        _ring.store(_rings.back().get());
+    }
+
+    void push(T* x) {
+        int64_t b = _bottom.load(std::memory_order_relaxed);
+        int64_t t = _top.load(std::memory_order_acquire);
+        Ring* r = _ring.load(std::memory_order_relaxed);
+        if (b - t > r->cap - 1) {
+            auto* bigger = new Ring(r->cap * 2);
+            for (int64_t i = t; i < b; ++i) bigger->put(i, r->get(i));
+            _rings.emplace_back(bigger);
+            _ring.store(bigger, std::memory_order_release);
+            r = bigger;
+        }
+        r->put(b, x);
+        _bottom.store(b + 1, std::memory_order_release);
+    }
+
+    T* pop() {
+        int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+        Ring* r = _ring.load(std::memory_order_relaxed);
+        _bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = _top.load(std::memory_order_relaxed);
+        T* x = nullptr;
+        if (t <= b) {
+            x = r->get(b);
+            if (t == b) {
+                if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    x = nullptr;
+                _bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        } else {
+            _bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return x;
+    }
+
+    T* steal() {
+        int64_t t = _top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = _bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        T* x = _ring.load(std::memory_order_acquire)->get(t);
+        if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return x;
+    }
+};
+
+// N workers, each owning a WorkDeque. Jobs are handed in through a lock-free
+// per-worker inbox (an intrusive stack on Job::nextRun) and moved into the
+// owner's deque; idle workers steal from other deques and inboxes, so one
+// slow job never holds up the rest.
+template <typename Job>
+class WorkerPool {
+public:
+    using Handler = std::function<void(Job*)>;
+
+    void start(unsigned n, bool pin, Handler handler) {
+        _handler = std::move(handler);
+        _running.store(true);
+        unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < n; ++i) _workers.emplace_back(new Worker);
+        for (unsigned i = 0; i < n; ++i) {
+            _workers[i]->thread = std::thread([this, i] { loop(i); });
+#ifdef __linux__
+            if (pin) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % cpus, &set);
+                pthread_setaffinity_np(_workers[i]->thread.native_handle(), sizeof set, &set);
+            }
+#else
+            (void)pin; (void)cpus;
+#endif
+        }
+    }
+
+    // Finishes every queued job, then joins.
+    void stop() {
+        _running.store(false);
+        {
+            std::lock_guard<std::mutex> lock(_idleMtx);
+            _idleCv.notify_all();
+        }
+        for (auto& w : _workers) w->thread.join();
+        _workers.clear();
+    }
+
+    // Queue j on worker `hint % size()`; call wake() once the batch is in.
+    void submit(Job* j, unsigned hint) {
+        auto& inbox = _workers[hint % _workers.size()]->inbox;
+        j->nextRun = inbox.load(std::memory_order_relaxed);
+        while (!inbox.compare_exchange_weak(j->nextRun, j, std::memory_order_release, std::memory_order_relaxed)) {}
+        _queued.fetch_add(1);
+    }
+
+    void wake() {
+        if (_sleepers.load() == 0) return;
+        std::lock_guard<std::mutex> lock(_idleMtx);
+        _idleCv.notify_all();
+    }
+
+    size_t size() const { return _workers.size(); }
+    size_t queued() const { return _queued.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker {
+        WorkDeque<Job> deque;
+        std::atomic<Job*> inbox{ nullptr };
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    Handler _handler;
+    std::atomic<bool> _running{ false };
+    std::atomic<size_t> _queued{ 0 };
+    std::atomic<unsigned> _sleepers{ 0 };
+    std::mutex _idleMtx;
+    std::condition_variable _idleCv;
+
+    // Move a whole inbox into `self`'s deque, oldest first.
+    bool drain(Worker& from, Worker& self) {
+        Job* j = from.inbox.exchange(nullptr, std::memory_order_acquire);
+        if (!j) return false;
+        Job* fifo = nullptr;
+        while (j) { Job* next = j->nextRun; j->nextRun = fifo; fifo = j; j = next; }
+        while (fifo) {
+            Job* next = fifo->nextRun;          // fifo may be stolen as soon as it is pushed
+            self.deque.push(fifo);
+            fifo = next;
+        }
+        return true;
+    }
+
+    Job* take(unsigned self, uint32_t& seed) {
+        Worker& me = *_workers[self];
+        if (Job* j = me.deque.pop()) return j;
+        if (drain(me, me)) return me.deque.pop();
+        size_t n = _workers.size();
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        for (size_t k = 1; k < n; ++k) {
+            Worker& victim = *_workers[(self + seed + k) % n];
+            if (&victim == &me) continue;
+            if (Job* j = victim.deque.steal()) return j;
+            if (drain(victim, me)) return me.deque.pop();
+        }
+        return nullptr;
+    }
+
+    void loop(unsigned self) {
+        uint32_t seed = self * 2654435761u + 1;
+        for (;;) {
+            if (Job* j = take(self, seed)) {
+                _queued.fetch_sub(1);
+                _handler(j);
+                continue;
+            }
+            if (_queued.load() != 0) { std::this_thread::yield(); continue; }
+            std::unique_lock<std::mutex> lock(_idleMtx);
+            _sleepers.fetch_add(1);
+            _idleCv.wait(lock, [this] { return _queued.load() != 0 || !_running.load(); });
+            _sleepers.fetch_sub(1);
+            if (!_running.load() && _queued.load() == 0) return;
+        }
     }
 };
 
+// Hierarchical hashed timing wheel: LEVELS wheels of SLOTS buckets, 1 ms per
+// tick. Level L holds timers due within SLOTS^(L+1) ticks; when a lower
+// level wraps, the matching bucket of the next level is cascaded down.
+// Timers are intrusive nodes from a pool, so schedule and cancel are O(1)
+// and a cancelled timer is unlinked and recycled at once.
+//
+// run() only keeps time: due timers are dispatched to a WorkerPool, and
+// finished ones come back through a lock-free completion stack that the
+// timer thread drains, so workers never take the wheel mutex.
 class Scheduler {
-    std::priority_queue<ScheduledTask, std::vector<ScheduledTask>, Earlier> _pq;
-    std::set<uint64_t> _cancelled;
-    std::vector<MutationEvent> _mutationLog;
+    static constexpr int BITS = 8;
+    static constexpr int LEVELS = 4;
+    static constexpr int64_t SLOTS = int64_t(1) << BITS;
+    static constexpr int64_t MASK = SLOTS - 1;
+    static constexpr int64_t SPAN = int64_t(1) << (BITS * LEVELS);   // ~49 days
+
+    struct Link {
+        Link* prev = this;
+        Link* next = this;
+        bool empty() const { return next == this; }
+    };
+
+    enum class NodeState : uint8_t { Free, Pending, Firing };
+    enum class Outcome : uint8_t { Ran, Failed, Skipped };
+
+    struct TimerNode : Link {
+        int64_t due = 0;
+        int64_t interval_ms = 0;
+        uint32_t index = 0;                 // position in _pool
+        uint32_t gen = 1;                   // bumped on recycle; high half of the id
+        NodeState state = NodeState::Free;
+        bool repeat = false;
+        std::atomic<bool> cancelled{ false };
+        Outcome outcome = Outcome::Ran;
+        int64_t due_ns = 0;                 // exact due time; `due` is its tick
+        int64_t finished_ns = 0;            // set by the worker
+        Task task;
+        CapsuleMeta meta;
+        CapsuleStats* stats = nullptr;
+        TimerNode* nextFree = nullptr;
+        TimerNode* nextRun = nullptr;       // worker inbox / completion stack
+
+        uint64_t id() const { return uint64_t(gen) << 32 | index; }
+    };
+
+    Link _wheel[LEVELS][SLOTS];
+    std::deque<TimerNode> _pool;            // stable addresses
+    TimerNode* _free = nullptr;
+    MutationLog _log;
+    int64_t _current;                       // last tick processed
+    size_t _pending = 0;                    // timers in the wheel
+    size_t _inFlight = 0;                   // dispatched, not yet reaped
+    unsigned _nextWorker = 0;
+    std::atomic<TimerNode*> _completed{ nullptr };
+    WorkerPool<TimerNode> _workers;
+    unsigned _workerCount;
+    bool _pinWorkers;
     std::mutex _mtx;
     std::condition_variable _cv;
-    std::atomic<bool> _running{ false };
-    std::atomic<uint64_t> _nextId{ 1 };
+    std::atomic<bool> _running{ true };     // stop() may come before run()
+    int64_t _dumpEvery = 0;                 // periodic metrics dump, see dumpMetricsEvery()
+    int64_t _nextDump = 0;
+    std::string _dumpPath;
+    bool _dumpJSON = false;
+    mutable std::mutex _statsMtx;
+    std::unordered_map<std::string, std::unique_ptr<CapsuleStats>> _stats;
 
 public:
+    // workers == 0 uses one per core; pinWorkers binds worker i to CPU i.
+    // Each logging thread keeps its last logCapacity mutation events.
+    explicit Scheduler(unsigned workers = 0, bool pinWorkers = false,
+                       size_t logCapacity = 4096, LogPolicy logPolicy = LogPolicy::Overwrite)
+        : _log(logCapacity, logPolicy),
+          _current(now_ms().ticks_ms - 1),
+          _workerCount(workers ? workers : std::max(1u, std::thread::hardware_concurrency())),
+          _pinWorkers(pinWorkers) {}
+
     uint64_t schedule(const Task& task, int64_t delay_ms, const CapsuleMeta& meta) {
         return scheduleImpl(task, delay_ms, false, 0, meta);
     }
@@ -75,40 +359,56 @@ public:
 
     void cancel(uint64_t id) {
         std::lock_guard<std::mutex> lock(_mtx);
-        _cancelled.insert(id);
+        TimerNode* n = lookup(id);
+        if (!n) return;
+        if (n->state == NodeState::Pending) {
+            unlink(n);
+            --_pending;
+            release(n);
+        } else {
+            n->cancelled.store(true);       // firing: skipped if not yet run, never rescheduled
+        }
         _cv.notify_all();
-        _mutationLog.push_back({ id, "cancelled", now_ms() });
+        _log.record(MutationType::Cancelled, id, now_ms().ticks_ms);
     }
 
     void run() {
-        _running.store(true);
+        _workers.start(_workerCount, _pinWorkers, [this](TimerNode* n) { execute(n); });
         while (_running.load()) {
             std::unique_lock<std::mutex> lock(_mtx);
-            if (_pq.empty()) {
-                _cv.wait(lock, [this] { return !_pq.empty() || !_running.load(); });
-                if (!_running.load()) break;
-            }
+            reap();
             auto now = now_ms();
-            if (!_pq.empty() && _pq.top().time.ticks_ms <= now.ticks_ms) {
-                auto cur = _pq.top();
-                _pq.pop();
-                if (_cancelled.find(cur.id) == _cancelled.end()) {
-                    lock.unlock();
-                    cur.task.invoke();
-                    lock.lock();
-                    _mutationLog.push_back({ cur.id, "executed", now_ms() });
-                    if (cur.repeat && _cancelled.find(cur.id) == _cancelled.end()) {
-                        ScheduledTask nextTask = cur;
-                        nextTask.time = add_ms(now, cur.interval_ms);
-                        _pq.push(nextTask);
-                        _mutationLog.push_back({ cur.id, "rescheduled", now_ms() });
-                        _cv.notify_all();
-                    }
-                }
-            } else if (!_pq.empty()) {
-                auto wake_at = _pq.top().time.ticks_ms;
-                _cv.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::milliseconds(wake_at)));
+            if (_dumpEvery > 0 && now.ticks_ms >= _nextDump) {
+                _nextDump = now.ticks_ms + _dumpEvery;
+                std::string path = _dumpPath;
+                bool json = _dumpJSON;
+                lock.unlock();                  // file I/O must not hold up schedule()
+                dumpMetrics(path, json);
+                continue;
+            }
+            if (_pending == 0 && _inFlight == 0) {
+                auto idle = [this] { return _pending != 0 || !_running.load(); };
+                if (_dumpEvery > 0) _cv.wait_until(lock, steady_at(_nextDump), idle);
+                else _cv.wait(lock, idle);
+                continue;
             }
+            if (_current < now.ticks_ms) {
+                tick();
+                continue;
+            }
+            // While jobs are out, wake every tick to re-arm repeating timers.
+            int64_t wake = _inFlight ? _current + 1 : nextWake();
+            if (_dumpEvery > 0) wake = std::min(wake, _nextDump);
+            _cv.wait_until(lock, steady_at(wake));
+        }
+        _workers.stop();
+        std::unique_lock<std::mutex> lock(_mtx);
+        reap();
+        if (_dumpEvery > 0) {
+            std::string path = _dumpPath;
+            bool json = _dumpJSON;
+            lock.unlock();
+            dumpMetrics(path, json);
         }
     }
 
@@ -118,43 +418,324 @@ public:
         _cv.notify_all();
     }
 
+    // Block until no timer is pending or running, at most timeout_ms
+    // (< 0 = no limit). True if the scheduler went idle.
+    bool waitIdle(int64_t timeout_ms) {
+        std::unique_lock<std::mutex> lock(_mtx);
+        auto idle = [this] { return (_pending == 0 && _inFlight == 0) || !_running.load(); };
+        if (timeout_ms < 0) {
+            _cv.wait(lock, idle);
+            return true;
+        }
+        return _cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), idle);
+    }
+
     std::vector<ScheduledTask> getPendingTasks() {
         std::lock_guard<std::mutex> lock(_mtx);
         std::vector<ScheduledTask> out;
-        auto tmp = _pq;
-        while (!tmp.empty()) {
-            out.push_back(tmp.top());
-            tmp.pop();
+        for (auto& level : _wheel)
+            for (auto& slot : level)
+                for (Link* l = slot.next; l != &slot; l = l->next) {
+                    auto* n = static_cast<TimerNode*>(l);
+                    out.push_back({ TimePoint{ n->due }, n->task, n->id(), n->repeat, n->interval_ms, n->meta });
+                }
+        std::sort(out.begin(), out.end(), [](const ScheduledTask& a, const ScheduledTask& b) {
+            return a.time.ticks_ms < b.time.ticks_ms;
+        });
+        return out;
+    }
+
+    std::vector<MutationEvent> getMutationHistory() const {
+        return _log.snapshot();
+    }
+
+    std::string renderTimeline() const {
+        return formatTimeline(_log.snapshot());
+    }
+
+    // Binary dump for the offline viewer (Timeline.cpp).
+    bool dumpMutations(const std::string& path) const {
+        return _log.dump(path);
+    }
+
+    // Lag, run time and queue depth per capsule name, sorted by name. Safe
+    // to call while timers fire.
+    std::vector<CapsuleMetrics> metrics() const {
+        std::vector<CapsuleMetrics> out;
+        {
+            std::lock_guard<std::mutex> lock(_statsMtx);
+            for (auto& kv : _stats)
+                out.push_back({ kv.first, kv.second->lag.snapshot(), kv.second->run.snapshot(), kv.second->depth.snapshot() });
         }
+        std::sort(out.begin(), out.end(), [](const CapsuleMetrics& a, const CapsuleMetrics& b) { return a.name < b.name; });
         return out;
     }
 
-    std::vector<MutationEvent> getMutationHistory() {
-        std::lock_guard<std::mutex> lock(_mtx);
-        return _mutationLog;
+    std::string metricsText() const {
+        std::ostringstream os;
+        os << std::left << std::setw(24) << "capsule" << std::setw(7) << "metric" << std::right
+           << std::setw(10) << "count" << std::setw(12) << "min" << std::setw(12) << "mean" << std::setw(12) << "p50"
+           << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12) << "p99.9"
+           << std::setw(12) << "max" << '\n';
+        for (auto& m : metrics()) {
+            auto row = [&](const char* metric, const HistogramSnapshot& h) {
+                os << std::left << std::setw(24) << m.name << std::setw(7) << metric << std::right
+                   << std::setw(10) << h.count << std::setw(12) << h.min
+                   << std::setw(12) << static_cast<int64_t>(h.mean + 0.5) << std::setw(12) << h.percentile(0.5)
+                   << std::setw(12) << h.percentile(0.9) << std::setw(12) << h.percentile(0.99)
+                   << std::setw(12) << h.percentile(0.999) << std::setw(12) << h.max << '\n';
+            };
+            row("lag", m.lag);
+            row("run", m.run);
+            row("depth", m.depth);
+        }
+        return os.str();
     }
 
-    std::string renderTimeline() {
-        std::lock_guard<std::mutex> lock(_mtx);
-        std::string sb;
-        for (const auto& e : _mutationLog) {
-            sb += "Task " + std::to_string(e.taskId) + " " + e.type + " at " + std::to_string(e.at.ticks_ms) + "ms\n";
+    std::string metricsJSON() const {
+        std::ostringstream os;
+        auto hist = [&](const HistogramSnapshot& h) {
+            os << "{\"count\":" << h.count << ",\"min\":" << h.min << ",\"mean\":" << h.mean
+               << ",\"p50\":" << h.percentile(0.5) << ",\"p90\":" << h.percentile(0.9)
+               << ",\"p99\":" << h.percentile(0.99) << ",\"p999\":" << h.percentile(0.999)
+               << ",\"max\":" << h.max << "}";
+        };
+        os << "{\"unit\":\"ns\",\"capsules\":[";
+        bool first = true;
+        for (auto& m : metrics()) {
+            if (!first) os << ',';
+            first = false;
+            os << "{\"name\":\"";
+            for (char c : m.name) {
+                if (c == '"' || c == '\\') os << '\\';
+                if (static_cast<unsigned char>(c) >= 0x20) os << c;
+            }
+            os << "\",\"lag\":";
+            hist(m.lag);
+            os << ",\"run\":";
+            hist(m.run);
+            os << ",\"depth\":";
+            hist(m.depth);
+            os << '}';
+        }
+        os << "]}\n";
+        return os.str();
+    }
+
+    // Rewrite `path` with the current metrics (JSON or text); "-" is stderr.
+    bool dumpMetrics(const std::string& path, bool json) const {
+        std::string body = json ? metricsJSON() : metricsText();
+        if (path == "-") {
+            std::cerr << body;
+            return true;
         }
-        return sb;
+        std::ofstream out(path, std::ios::trunc);
+        out << body;
+        return static_cast<bool>(out);
+    }
+
+    // Have run() rewrite `path` every interval_ms and once more when it
+    // stops; interval_ms <= 0 turns it off. The dump is not a timer, so it
+    // never keeps waitIdle() from returning.
+    void dumpMetricsEvery(int64_t interval_ms, const std::string& path, bool json) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _dumpEvery = interval_ms;
+        _dumpPath = path;
+        _dumpJSON = json;
+        _nextDump = now_ms().ticks_ms + interval_ms;
+        _cv.notify_all();
     }
 
 private:
     uint64_t scheduleImpl(const Task& task, int64_t delay_ms, bool repeat, int64_t interval_ms, const CapsuleMeta& meta) {
         std::lock_guard<std::mutex> lock(_mtx);
-        uint64_t id = _nextId.fetch_add(1);
-        ScheduledTask st{ add_ms(now_ms(), delay_ms), task, id, repeat, interval_ms, meta };
-        _pq.push(st);
-        _mutationLog.push_back({ id, "scheduled", now_ms() });
+        auto now = now_ms();
+        // An empty wheel has nothing to catch up on: skip the idle ticks.
+        if (_pending == 0 && _current < now.ticks_ms - 1) _current = now.ticks_ms - 1;
+        TimerNode* n = acquire();
+        n->due_ns = now_ns() + delay_ms * 1000000;
+        n->due = ceil_ms(n->due_ns);
+        n->repeat = repeat;
+        n->interval_ms = interval_ms;
+        n->task = task;
+        n->meta = meta;
+        n->stats = statsFor(meta.name);
+        n->state = NodeState::Pending;
+        place(n);
+        ++_pending;
+        _log.record(MutationType::Scheduled, n->id(), now.ticks_ms);
         _cv.notify_all();
-        return id;
+        return n->id();
+    }
+
+    static int64_t ceil_ms(int64_t ns) {
+        return ns / 1000000 + (ns % 1000000 > 0);
+    }
+
+    // Stats live until the Scheduler dies, so nodes keep a plain pointer.
+    CapsuleStats* statsFor(const std::string& name) {
+        std::lock_guard<std::mutex> lock(_statsMtx);
+        auto& slot = _stats[name];
+        if (!slot) slot.reset(new CapsuleStats);
+        return slot.get();
+    }
+
+    TimerNode* acquire() {
+        TimerNode* n = _free;
+        if (n) {
+            _free = n->nextFree;
+        } else {
+            _pool.emplace_back();
+            n = &_pool.back();
+            n->index = static_cast<uint32_t>(_pool.size() - 1);
+        }
+        n->cancelled.store(false);
+        return n;
+    }
+
+    void release(TimerNode* n) {
+        n->state = NodeState::Free;
+        n->task = Task{};
+        n->meta = CapsuleMeta{};
+        n->stats = nullptr;
+        ++n->gen;
+        n->nextFree = _free;
+        _free = n;
+    }
+
+    TimerNode* lookup(uint64_t id) {
+        uint32_t index = static_cast<uint32_t>(id);
+        if (index >= _pool.size()) return nullptr;
+        TimerNode* n = &_pool[index];
+        return n->gen == uint32_t(id >> 32) && n->state != NodeState::Free ? n : nullptr;
+    }
+
+    static void unlink(Link* l) {
+        l->prev->next = l->next;
+        l->next->prev = l->prev;
+        l->prev = l->next = l;
+    }
+
+    static void append(Link& slot, Link* l) {
+        l->prev = slot.prev;
+        l->next = &slot;
+        slot.prev->next = l;
+        slot.prev = l;
+    }
+
+    // Move every node of `slot` onto `out` (O(1) splice).
+    static void splice(Link& slot, Link& out) {
+        if (slot.empty()) return;
+        out.next = slot.next;
+        out.prev = slot.prev;
+        out.next->prev = &out;
+        out.prev->next = &out;
+        slot.next = slot.prev = &slot;
+    }
+
+    // Bucket n relative to the next tick to process. Timers beyond the
+    // wheel's span park in the top level and are re-placed as they cascade.
+    void place(TimerNode* n) {
+        int64_t base = _current + 1;
+        int64_t due = std::max(n->due, base);
+        int64_t delta = due - base;
+        if (delta >= SPAN) { due = base + SPAN - 1; delta = SPAN - 1; }
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (int64_t(1) << (BITS * (level + 1)))) ++level;
+        append(_wheel[level][(due >> (BITS * level)) & MASK], n);
+    }
+
+    // Process tick _current + 1: cascade wrapped levels, then hand the whole
+    // level-0 bucket to the workers as one batch. Called with _mtx held.
+    void tick() {
+        int64_t t = _current + 1;
+        for (int level = 1; level < LEVELS; ++level) {
+            if ((t >> (BITS * (level - 1))) & MASK) break;
+            Link moving;
+            splice(_wheel[level][(t >> (BITS * level)) & MASK], moving);
+            while (!moving.empty()) {
+                auto* n = static_cast<TimerNode*>(moving.next);
+                unlink(n);
+                place(n);
+            }
+        }
+        Link expired;
+        splice(_wheel[0][t & MASK], expired);
+        _current = t;
+        bool dispatched = false;
+        while (!expired.empty()) {
+            auto* n = static_cast<TimerNode*>(expired.next);
+            unlink(n);
+            if (n->due > t) { place(n); continue; }      // parked far timer
+            n->state = NodeState::Firing;
+            --_pending;
+            ++_inFlight;
+            n->stats->depth.record(_workers.queued());
+            _workers.submit(n, _nextWorker++);
+            dispatched = true;
+        }
+        if (dispatched) _workers.wake();
+    }
+
+    // Worker side: run the task and push the node onto the completion stack.
+    void execute(TimerNode* n) {
+        n->outcome = Outcome::Skipped;
+        int64_t started = now_ns();
+        if (!n->cancelled.load()) {
+            n->stats->lag.record(static_cast<uint64_t>(std::max<int64_t>(0, started - n->due_ns)));
+            try {
+                n->task.invoke();
+                n->outcome = Outcome::Ran;
+            } catch (...) {
+                n->outcome = Outcome::Failed;
+            }
+        }
+        n->finished_ns = now_ns();
+        if (n->outcome != Outcome::Skipped) {
+            n->stats->run.record(static_cast<uint64_t>(n->finished_ns - started));
+            _log.record(n->outcome == Outcome::Ran ? MutationType::Executed : MutationType::Failed, n->id(), n->finished_ns / 1000000);
+        }
+        n->nextRun = _completed.load(std::memory_order_relaxed);
+        while (!_completed.compare_exchange_weak(n->nextRun, n, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    // Timer side: re-arm finished repeating timers and recycle the rest.
+    // Called with _mtx held.
+    void reap() {
+        TimerNode* n = _completed.exchange(nullptr, std::memory_order_acquire);
+        if (n) _cv.notify_all();            // waitIdle()
+        while (n) {
+            TimerNode* next = n->nextRun;
+            uint64_t id = n->id();
+            bool cancelled = n->cancelled.load();
+            --_inFlight;
+            if (n->repeat && !cancelled) {
+                n->due_ns = n->finished_ns + n->interval_ms * 1000000;
+                n->due = ceil_ms(n->due_ns);
+                n->state = NodeState::Pending;
+                place(n);
+                ++_pending;
+                _log.record(MutationType::Rescheduled, id, n->finished_ns / 1000000);
+            } else {
+                release(n);
+            }
+            n = next;
+        }
+    }
+
+    // Caught up: sleep until the next non-empty level-0 bucket, or until
+    // level 0 wraps and the next cascade is due.
+    int64_t nextWake() const {
+        int64_t t = _current + 1;
+        do {
+            if (!_wheel[0][t & MASK].empty()) return t;
+            ++t;
+        } while (t & MASK);
+        return t;
     }
 };
 
+#ifdef SCHEDULER_DEMO
 // Example usage
 void hello_once() {
     std::cout << "Hello from one-time task!" << std::endl;
@@ -183,6 +764,8 @@ int main() {
 
     std::cout << "Scheduler stopped." << std::endl;
     std::cout << sched.renderTimeline();
+    std::cout << sched.metricsText();
 
     return 0;
 }
+#endif
@@ -1,21 +1,171 @@
 #pragma once
-#include <queue>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
-#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
-struct Task {
-    std::string name;
-    std::function<void()> fn;
+// The simple queue-backed scheduler. It lives in its own namespace because
+// Scheduler.cpp (the timing wheel the VM uses) also defines Task and
+// Scheduler; SchedBench.cpp is the translation unit that builds it.
+namespace simple_sched {
+
+// Interned task names; tasks carry the 32-bit id instead of a string.
+class NameTable {
+    mutable std::mutex mtx;
+    std::deque<std::string> names;                       // stable references
+    std::unordered_map<std::string, uint32_t> ids;
+public:
+    uint32_t intern(const std::string& s){
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        names.push_back(s);
+        return ids[s] = static_cast<uint32_t>(names.size()-1);
+    }
+    const std::string& name(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return names.at(id);
+    }
+};
+
+// Move-only callable. Callables up to INLINE bytes that move without
+// throwing are stored in place; larger ones fall back to the heap.
+class Task {
+public:
+    static constexpr std::size_t INLINE = 48;
+
+    Task() = default;
+    template<class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, Task>::value>>
+    Task(uint32_t name, F&& f) : name(name) {
+        using Fn = std::decay_t<F>;
+        if constexpr (sizeof(Fn) <= INLINE && alignof(Fn) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<Fn>::value){
+            new (buf) Fn(std::forward<F>(f));
+            ops = &inlineOps<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(buf) = new Fn(std::forward<F>(f));
+            ops = &heapOps<Fn>;
+        }
+    }
+    Task(Task&& o) noexcept : name(o.name), ops(o.ops) { if (ops){ ops->move(buf, o.buf); o.reset(); } }
+    Task& operator=(Task&& o) noexcept {
+        if (this != &o){ reset(); name = o.name; ops = o.ops; if (ops){ ops->move(buf, o.buf); o.reset(); } }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task(){ reset(); }
+
+    void operator()(){ ops->invoke(buf); }
+    explicit operator bool() const { return ops != nullptr; }
+    uint32_t name = 0;
+
+private:
+    struct Ops {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src);              // leaves src destroyable
+        void (*destroy)(void*);
+    };
+    template<class Fn> static constexpr Ops inlineOps = {
+        [](void* p){ (*static_cast<Fn*>(p))(); },
+        [](void* d, void* s){ new (d) Fn(std::move(*static_cast<Fn*>(s))); },
+        [](void* p){ static_cast<Fn*>(p)->~Fn(); },
+    };
+    template<class Fn> static constexpr Ops heapOps = {
+        [](void* p){ (**static_cast<Fn**>(p))(); },
+        [](void* d, void* s){ *static_cast<Fn**>(d) = *static_cast<Fn**>(s); *static_cast<Fn**>(s) = nullptr; },
+        [](void* p){ delete *static_cast<Fn**>(p); },
+    };
+
+    alignas(std::max_align_t) unsigned char buf[INLINE];
+    const Ops* ops = nullptr;
+
+    void reset(){ if (ops){ ops->destroy(buf); ops = nullptr; } }
 };
 
+// Bounded multi-producer/multi-consumer queue (Vyukov): one CAS per push or
+// pop, no locks. Capacity is rounded up to a power of two.
+template<class T>
+class MPMCQueue {
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+    };
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> head{0};        // next push
+    alignas(64) std::atomic<std::size_t> tail{0};        // next pop
+
+    static std::size_t roundUp(std::size_t n){ std::size_t c=2; while (c<n) c<<=1; return c; }
+public:
+    explicit MPMCQueue(std::size_t capacity) : cells(new Cell[roundUp(capacity)]), mask(roundUp(capacity)-1) {
+        for (std::size_t i=0;i<=mask;i++) cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    ~MPMCQueue(){ T t; while (pop(t)) {} }
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    bool push(T&& v){                                     // false when full
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        for(;;){
+            Cell& c = cells[pos & mask];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0){
+                if (head.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)){
+                    new (&c.data) T(std::move(v));
+                    c.seq.store(pos+1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) return false;
+            else pos = head.load(std::memory_order_relaxed);
+        }
+    }
+    bool pop(T& out){                                     // false when empty
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;){
+            Cell& c = cells[pos & mask];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos+1);
+            if (diff == 0){
+                if (tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)){
+                    T* p = reinterpret_cast<T*>(&c.data);
+                    out = std::move(*p);
+                    p->~T();
+                    c.seq.store(pos+mask+1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) return false;
+            else pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+};
+
+// Simple run-to-completion scheduler. submit() may be called from any
+// thread; run() drains whatever is queued on the calling thread.
 class Scheduler {
-    std::queue<Task> q;
+    NameTable names;
+    MPMCQueue<Task> q;
 public:
-    void submit(const std::string& name, std::function<void()> fn){ q.push({name,std::move(fn)}); }
+    explicit Scheduler(std::size_t capacity=4096) : q(capacity) {}
+
+    uint32_t intern(const std::string& name){ return names.intern(name); }
+    const std::string& name(const Task& t) const { return names.name(t.name); }
+
+    // Returns false when the queue is full.
+    template<class F> bool submit(uint32_t name, F&& fn){ return q.push(Task(name, std::forward<F>(fn))); }
+    template<class F> bool submit(const std::string& name, F&& fn){ return submit(intern(name), std::forward<F>(fn)); }
+
     void run(){
-        while(!q.empty()){
-            auto t = q.front(); q.pop();
-            t.fn();
-        }
+        Task t;
+        while (q.pop(t)) t();
     }
 };
+
+} // namespace simple_sched
@@ -0,0 +1,241 @@
+#include "Server.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Request: "CMJS", u32 payload bytes (with fds 0, 1, 2 attached), then the
+// payload: cwd \0 arg0 \0 arg1 \0 ... Reply: the request's exit status as
+// an i32 once it has finished.
+static const char REQUEST_MAGIC[4] = { 'C', 'M', 'J', 'S' };
+static const std::uint32_t MAX_REQUEST = 1u << 24;
+
+static int sigPipe[2] = { -1, -1 };        // SIGCHLD / SIGTERM wake the poll loop
+static volatile std::sig_atomic_t stopping = 0;
+
+static void onSignal(int sig){
+    if (sig != SIGCHLD) stopping = 1;
+    int saved = errno;
+    char c = 0;
+    if (::write(sigPipe[1], &c, 1) < 0) {}
+    errno = saved;
+}
+
+static bool socketAddr(const std::string& path, sockaddr_un& a){
+    if (path.empty() || path.size() >= sizeof a.sun_path) return false;
+    std::memset(&a, 0, sizeof a);
+    a.sun_family = AF_UNIX;
+    std::memcpy(a.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static bool readAll(int fd, void* data, std::size_t n){
+    auto* p = static_cast<char*>(data);
+    while (n){
+        ssize_t r = ::read(fd, p, n);
+        if (r<0 && errno==EINTR) continue;
+        if (r<=0) return false;
+        p+=r; n-=static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+static bool sendAll(int fd, const void* data, std::size_t n){
+    auto* p = static_cast<const char*>(data);
+    while (n){
+        ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (w<0 && errno==EINTR) continue;
+        if (w<=0) return false;
+        p+=w; n-=static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+static int connectTo(const std::string& path){
+    sockaddr_un a;
+    if (!socketAddr(path, a)) return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd<0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof a)!=0){ ::close(fd); return -1; }
+    return fd;
+}
+
+std::string defaultServerSocket(){
+    const char* dir = std::getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir) return std::string(dir)+"/cmajor.sock";
+    return "/tmp/cmajor-"+std::to_string(::getuid())+".sock";
+}
+
+bool forward(const std::string& path, const std::vector<std::string>& args, int& status){
+    int fd = connectTo(path);
+    if (fd<0) return false;
+    char cwd[PATH_MAX];
+    if (!::getcwd(cwd, sizeof cwd)){ ::close(fd); return false; }
+    std::string payload = cwd;
+    payload += '\0';
+    for (auto& a : args){ payload += a; payload += '\0'; }
+
+    char head[8];
+    std::uint32_t len = static_cast<std::uint32_t>(payload.size());
+    std::memcpy(head, REQUEST_MAGIC, 4);
+    std::memcpy(head+4, &len, 4);
+    iovec iov{ head, sizeof head };
+    alignas(cmsghdr) char ctl[CMSG_SPACE(3*sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov; msg.msg_iovlen = 1;
+    msg.msg_control = ctl; msg.msg_controllen = sizeof ctl;
+    cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET; cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(3*sizeof(int));
+    const int stdio[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    std::memcpy(CMSG_DATA(cm), stdio, sizeof stdio);
+    if (::sendmsg(fd, &msg, MSG_NOSIGNAL)!=static_cast<ssize_t>(sizeof head) || !sendAll(fd, payload.data(), payload.size())){
+        ::close(fd);
+        return false;   // nothing ran yet: run it here instead
+    }
+    std::int32_t st = 0;
+    if (!readAll(fd, &st, sizeof st)){
+        std::cerr<<"cmajor: lost connection to server "<<path<<"\n";
+        st = 1;
+    }
+    ::close(fd);
+    status = st;
+    return true;
+}
+
+namespace {
+struct Request {
+    int fds[3] = { -1, -1, -1 };
+    std::string cwd;
+    std::vector<std::string> args;
+    ~Request(){ for (int fd : fds) if (fd>=0) ::close(fd); }
+};
+}
+
+static bool receive(int conn, Request& r){
+    char head[8];
+    iovec iov{ head, sizeof head };
+    alignas(cmsghdr) char ctl[CMSG_SPACE(3*sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov; msg.msg_iovlen = 1;
+    msg.msg_control = ctl; msg.msg_controllen = sizeof ctl;
+    ssize_t n;
+    do n = ::recvmsg(conn, &msg, MSG_CMSG_CLOEXEC); while (n<0 && errno==EINTR);
+    for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        if (cm->cmsg_level==SOL_SOCKET && cm->cmsg_type==SCM_RIGHTS && cm->cmsg_len==CMSG_LEN(3*sizeof(int)))
+            std::memcpy(r.fds, CMSG_DATA(cm), sizeof r.fds);
+    if (n<=0 || r.fds[0]<0) return false;
+    if (n<static_cast<ssize_t>(sizeof head) && !readAll(conn, head+n, sizeof head-static_cast<std::size_t>(n))) return false;
+    std::uint32_t len;
+    std::memcpy(&len, head+4, 4);
+    if (std::memcmp(head, REQUEST_MAGIC, 4)!=0 || len>MAX_REQUEST) return false;
+    std::string payload(len, '\0');
+    if (!readAll(conn, &payload[0], len)) return false;
+    std::size_t p = payload.find('\0');
+    if (p==std::string::npos) return false;
+    r.cwd = payload.substr(0, p);
+    for (std::size_t q; (q = payload.find('\0', ++p))!=std::string::npos; p = q)
+        r.args.push_back(payload.substr(p, q-p));
+    return !r.args.empty();
+}
+
+static void reply(int conn, int status){
+    std::int32_t st = status;
+    sendAll(conn, &st, sizeof st);
+    ::close(conn);
+}
+
+int serve(const std::string& where, const ServerPrepare& prepare, const ServerHandle& handle){
+    // absolute: every request changes the server's working directory
+    std::string path = where;
+    char cwd[PATH_MAX];
+    if (!path.empty() && path[0]!='/' && ::getcwd(cwd, sizeof cwd)) path = std::string(cwd)+"/"+path;
+    sockaddr_un a;
+    if (!socketAddr(path, a)){ std::cerr<<"Bad socket path "<<path<<"\n"; return 1; }
+    int probe = connectTo(path);
+    if (probe>=0){ ::close(probe); std::cerr<<"A server is already listening on "<<path<<"\n"; return 1; }
+    ::unlink(path.c_str());    // left behind by a server that did not exit cleanly
+    int lfd = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (lfd<0 || ::bind(lfd, reinterpret_cast<sockaddr*>(&a), sizeof a)!=0 || ::listen(lfd, 128)!=0){
+        std::cerr<<"Cannot listen on "<<path<<": "<<std::strerror(errno)<<"\n";
+        return 1;
+    }
+    if (::pipe2(sigPipe, O_CLOEXEC|O_NONBLOCK)!=0){ std::cerr<<"pipe: "<<std::strerror(errno)<<"\n"; return 1; }
+    struct sigaction sa{};
+    sa.sa_handler = onSignal;
+    sa.sa_flags = SA_RESTART|SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    for (int sig : { SIGCHLD, SIGINT, SIGTERM }) sigaction(sig, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cerr<<"cmajor: serving on "<<path<<"\n";
+
+    std::map<pid_t,int> running;    // request process -> client connection
+    auto reap = [&]{
+        int st; pid_t pid;
+        while ((pid = ::waitpid(-1, &st, WNOHANG))>0){
+            auto it = running.find(pid);
+            if (it==running.end()) continue;
+            reply(it->second, WIFEXITED(st) ? WEXITSTATUS(st) : 128+WTERMSIG(st));
+            running.erase(it);
+        }
+    };
+    while (!stopping){
+        std::vector<pollfd> fds{ { lfd, POLLIN, 0 }, { sigPipe[0], POLLIN, 0 } };
+        std::vector<pid_t> pids;
+        for (auto& r : running){ fds.push_back({ r.second, POLLIN, 0 }); pids.push_back(r.first); }
+        if (::poll(fds.data(), fds.size(), -1)<0){
+            if (errno==EINTR) continue;
+            std::cerr<<"poll: "<<std::strerror(errno)<<"\n";
+            break;
+        }
+        if (fds[1].revents){
+            char drain[64];
+            while (::read(sigPipe[0], drain, sizeof drain)>0) {}
+            reap();
+        }
+        // a client that hangs up (^C) takes its request down with it
+        for (std::size_t k = 2; k<fds.size(); ++k){
+            if (!fds[k].revents) continue;
+            char c;
+            ssize_t n = ::recv(fds[k].fd, &c, 1, MSG_DONTWAIT);
+            if (n==0 || (n<0 && errno!=EAGAIN && errno!=EINTR)) ::kill(pids[k-2], SIGKILL);
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+        int conn = ::accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn<0) continue;
+        timeval tv{ 2, 0 };        // a stalled client must not stall the server
+        ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+        Request req;
+        if (!receive(conn, req) || ::chdir(req.cwd.c_str())!=0){ reply(conn, 1); continue; }
+        try { prepare(req.args); }
+        catch (const std::exception& e){ std::cerr<<"cmajor: server: "<<e.what()<<"\n"; }
+        pid_t pid = ::fork();
+        if (pid==0){
+            ::close(lfd); ::close(sigPipe[0]); ::close(sigPipe[1]); ::close(conn);
+            for (auto& r : running) ::close(r.second);
+            for (int sig : { SIGCHLD, SIGINT, SIGTERM, SIGPIPE }) std::signal(sig, SIG_DFL);
+            for (int fd = 0; fd<3; ++fd) ::dup2(req.fds[fd], fd);
+            for (int& fd : req.fds){ ::close(fd); fd = -1; }
+            ::_exit(handle(req.args));
+        }
+        if (pid<0){ std::cerr<<"fork: "<<std::strerror(errno)<<"\n"; reply(conn, 1); continue; }
+        running[pid] = conn;
+    }
+
+    for (auto& r : running){ ::kill(r.first, SIGTERM); ::close(r.second); }
+    ::close(lfd);
+    ::unlink(path.c_str());
+    std::cerr<<"cmajor: server stopped\n";
+    return 0;
+}
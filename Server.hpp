@@ -0,0 +1,28 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+// Compile server (cmajor --server) and its thin client (cmajor --client).
+//
+// The client connects to a Unix socket and sends its working directory,
+// its arguments and, as SCM_RIGHTS, its stdin/stdout/stderr. The server
+// runs `prepare` itself, inside the client's working directory, so that
+// whatever it caches stays warm for later requests. It then forks, and
+// the child runs `handle` on the client's descriptors. The child's exit
+// status goes back to the client, which exits with it. Each request gets
+// a copy-on-write snapshot of the server's caches, and what the request
+// does to them is dropped with the child.
+
+std::string defaultServerSocket();     // $XDG_RUNTIME_DIR/cmajor.sock or /tmp/cmajor-<uid>.sock
+
+using ServerPrepare = std::function<void(const std::vector<std::string>& args)>;
+using ServerHandle = std::function<int(const std::vector<std::string>& args)>;
+
+// Serve until SIGINT/SIGTERM. `prepare` must not start threads: the
+// server forks for every request.
+int serve(const std::string& path, const ServerPrepare& prepare, const ServerHandle& handle);
+
+// Send args to the server at `path` and wait for the exit status. Returns
+// false if no server is listening, so the caller can run the request itself.
+bool forward(const std::string& path, const std::vector<std::string>& args, int& status);
@@ -0,0 +1,45 @@
+// Offline viewer for Scheduler mutation dumps (Scheduler::dumpMutations).
+//
+//   cmajor_timeline <dump> [--task=<id>] [--summary]
+#include "MutationLog.hpp"
+#include <iostream>
+#include <map>
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: cmajor_timeline <dump> [--task=<id>] [--summary]\n";
+        return 1;
+    }
+    std::string path;
+    bool summary = false, filter = false;
+    uint64_t task = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--summary") summary = true;
+        else if (a.rfind("--task=", 0) == 0) { filter = true; task = std::stoull(a.substr(7)); }
+        else path = a;
+    }
+    std::vector<MutationEvent> events;
+    uint64_t dropped = 0;
+    if (!MutationLog::load(path, events, dropped)) {
+        std::cerr << "Cannot read mutation dump " << path << "\n";
+        return 1;
+    }
+    if (filter) {
+        std::vector<MutationEvent> kept;
+        for (auto& e : events)
+            if (e.taskId == task) kept.push_back(e);
+        events.swap(kept);
+    }
+    if (summary) {
+        std::map<std::string, uint64_t> counts;
+        for (auto& e : events) counts[mutationName(e.type)]++;
+        for (auto& c : counts) std::cout << c.first << " " << c.second << "\n";
+        if (!events.empty())
+            std::cout << "span " << events.back().at_ms - events.front().at_ms << "ms\n";
+    } else {
+        std::cout << formatTimeline(events);
+    }
+    if (dropped) std::cout << "(" << dropped << " events dropped)\n";
+    return 0;
+}
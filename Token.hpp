@@ -6,7 +6,8 @@ enum class TokenType {
     Identifier, Number, Float, String,
     // keywords
     KwCapsule, KwFunc, KwStruct, KwClass, KwLet, KwReturn,
-    KwIf, KwElse, KwLoop, KwFrom, KwTo, KwSay,
+    KwIf, KwElse, KwLoop, KwFrom, KwTo, KwSay, KwParallel,
+    KwSchedule, KwAfter, KwEvery,
     KwEnd,
     // symbols
     LParen, RParen, LBrace, RBrace, Colon, Semicolon, Comma,
@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Binary execution trace (--trace=<prefix>). Every thread that runs VM code
+// owns a memory-mapped ring file <prefix>.<n>: a header and a power-of-two
+// array of fixed 16-byte events. Writing an event is a clock read and
+// three stores, with no formatting or locking. The ring keeps the newest
+// `capacity` events, and the kernel keeps the pages if the process dies.
+// <prefix>.names maps function indices to names and ticks to wall time;
+// the VM writes it when tracing stops. Offline, cmajor_trace turns all of
+// it into Chrome trace-event JSON (TraceConvert.cpp).
+
+enum class TraceType : std::uint8_t {
+    Enter,      // fn was called
+    Exit,       // fn returned
+    Branch,     // jump taken in fn, to decoded pc
+    Say,        // say at fn:pc
+    Timer       // schedule / every fired fn on a timer worker
+};
+
+inline const char* traceName(TraceType t) {
+    switch (t) {
+    case TraceType::Enter: return "enter";
+    case TraceType::Exit: return "exit";
+    case TraceType::Branch: return "branch";
+    case TraceType::Say: return "say";
+    case TraceType::Timer: return "timer";
+    }
+    return "?";
+}
+
+struct TraceEvent {
+    std::uint64_t ts;           // traceClock() ticks
+    std::uint32_t fn;           // function index, see <prefix>.names
+    std::uint32_t info;         // TraceType | pc << 8
+    TraceType type() const { return static_cast<TraceType>(info & 0xff); }
+    std::uint32_t pc() const { return info >> 8; }
+};
+static_assert(sizeof(TraceEvent) == 16, "trace events are 16 bytes on disk");
+
+constexpr char TRACE_MAGIC[8] = { 'C', 'M', 'J', 'T', 'R', 'A', 'C', 'E' };
+constexpr std::uint32_t TRACE_VERSION = 1;
+
+struct TraceFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t thread;       // ring number, the Chrome tid
+    std::uint64_t capacity;     // events, a power of two
+    std::atomic<std::uint64_t> head;    // events ever written; the newest is head - 1
+};
+
+// rdtsc where there is one: a few ns, against ~20 for clock_gettime.
+inline std::uint64_t traceClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+#endif
+}
+
+inline std::uint64_t traceNowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+// One thread's ring; only that thread writes it.
+class TraceRing {
+public:
+    ~TraceRing() { if (map) munmap(map, bytes); }
+
+    static std::unique_ptr<TraceRing> create(const std::string& path, std::uint32_t thread, std::uint64_t capacity) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return nullptr;
+        std::size_t bytes = sizeof(TraceFileHeader) + capacity * sizeof(TraceEvent);
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return nullptr;
+        std::unique_ptr<TraceRing> r(new TraceRing);
+        r->map = p;
+        r->bytes = bytes;
+        r->hdr = static_cast<TraceFileHeader*>(p);
+        std::memcpy(r->hdr->magic, TRACE_MAGIC, 8);
+        r->hdr->version = TRACE_VERSION;
+        r->hdr->thread = thread;
+        r->hdr->capacity = capacity;
+        r->hdr->head.store(0, std::memory_order_relaxed);
+        r->events = reinterpret_cast<TraceEvent*>(r->hdr + 1);
+        r->mask = capacity - 1;
+        return r;
+    }
+
+    // Out of line: inlined at every hook it bloats the VM's dispatch loop
+    // and costs untraced runs several percent.
+    __attribute__((noinline)) void emit(TraceType t, std::uint32_t fn, std::uint32_t pc) {
+        std::uint64_t h = hdr->head.load(std::memory_order_relaxed);
+        TraceEvent& e = events[h & mask];
+        e.ts = traceClock();
+        e.fn = fn;
+        e.info = static_cast<std::uint32_t>(t) | pc << 8;
+        hdr->head.store(h + 1, std::memory_order_release);
+    }
+
+private:
+    TraceRing() = default;
+    void* map = nullptr;
+    std::size_t bytes = 0;
+    TraceFileHeader* hdr = nullptr;
+    TraceEvent* events = nullptr;
+    std::uint64_t mask = 0;
+};
+
+// Hands each thread its ring on first use and writes <prefix>.names.
+class Tracer {
+public:
+    Tracer(std::string prefix, std::uint64_t capacity)
+        : prefix(std::move(prefix)), id(++lastId), tsc0(traceClock()), ns0(traceNowNs()) {
+        this->capacity = 1024;
+        while (this->capacity < capacity) this->capacity <<= 1;
+    }
+
+    // The calling thread's ring; null if its file could not be created.
+    TraceRing* ring() {
+        if (tlsOwner == id) return tlsRing;
+        std::lock_guard<std::mutex> lock(mtx);
+        auto n = static_cast<std::uint32_t>(rings.size());
+        auto r = TraceRing::create(prefix + "." + std::to_string(n), n, capacity);
+        if (!r) failed = true;
+        tlsRing = r.get();
+        tlsOwner = id;
+        rings.push_back(std::move(r));
+        return tlsRing;
+    }
+
+    // Write <prefix>.names: clock calibration, then `names[i]` for function i.
+    bool finish(const std::vector<std::string>& names) const {
+        std::uint64_t tsc1 = traceClock(), ns1 = traceNowNs();
+        std::ofstream out(prefix + ".names");
+        out << "cmajor-trace " << TRACE_VERSION << "\n";
+        out << "clock " << tsc0 << ' ' << ns0 << ' ' << tsc1 << ' ' << ns1 << "\n";
+        out << "rings " << rings.size() << "\n";
+        for (std::size_t i = 0; i < names.size(); ++i) out << "fn " << i << ' ' << names[i] << "\n";
+        return static_cast<bool>(out) && !failed;
+    }
+
+private:
+    static inline std::atomic<std::uint64_t> lastId{ 0 };
+    static inline thread_local std::uint64_t tlsOwner = 0;
+    static inline thread_local TraceRing* tlsRing = nullptr;
+
+    std::string prefix;
+    std::uint64_t capacity;
+    const std::uint64_t id;
+    const std::uint64_t tsc0, ns0;
+    std::mutex mtx;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    bool failed = false;
+};
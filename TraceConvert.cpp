@@ -0,0 +1,143 @@
+// Converts a --trace capture into Chrome trace-event JSON (chrome://tracing,
+// Perfetto, speedscope).
+//
+//   cmajor_trace <prefix> [-o out.json] [--no-branches]
+#include "Trace.hpp"
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
+
+static void jsonString(std::ostream& os, const std::string& s) {
+    os << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') os << '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) os << c;
+    }
+    os << '"';
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: cmajor_trace <prefix> [-o out.json] [--no-branches]\n";
+        return 1;
+    }
+    std::string prefix, outPath;
+    bool branches = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "-o" && i + 1 < argc) outPath = argv[++i];
+        else if (a == "--no-branches") branches = false;
+        else prefix = a;
+    }
+
+    std::ifstream meta(prefix + ".names");
+    if (!meta) {
+        std::cerr << "Cannot read " << prefix << ".names (was tracing stopped cleanly?)\n";
+        return 1;
+    }
+    std::uint64_t tsc0 = 0, ns0 = 0, tsc1 = 1, ns1 = 1, rings = 0;
+    std::unordered_map<std::uint32_t, std::string> names;
+    for (std::string line; std::getline(meta, line);) {
+        std::istringstream ls(line);
+        std::string key;
+        ls >> key;
+        if (key == "clock") ls >> tsc0 >> ns0 >> tsc1 >> ns1;
+        else if (key == "rings") ls >> rings;
+        else if (key == "fn") {
+            std::uint32_t idx;
+            std::string name;
+            ls >> idx >> name;
+            names[idx] = name;
+        }
+    }
+    double nsPerTick = tsc1 > tsc0 ? double(ns1 - ns0) / double(tsc1 - tsc0) : 1.0;
+    auto usOf = [&](std::uint64_t ts) { return (double(ts) - double(tsc0)) * nsPerTick / 1000.0; };
+    auto nameOf = [&](std::uint32_t fn) {
+        auto it = names.find(fn);
+        return it != names.end() ? it->second : "fn#" + std::to_string(fn);
+    };
+
+    std::ofstream file;
+    if (!outPath.empty()) {
+        file.open(outPath);
+        if (!file) { std::cerr << "Cannot write " << outPath << "\n"; return 1; }
+    }
+    std::ostream& out = outPath.empty() ? std::cout : file;
+    out.precision(15);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    auto begin = [&](const char* ph, std::uint32_t tid, double us) {
+        out << (first ? "" : ",\n") << "{\"ph\":\"" << ph << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << us;
+        first = false;
+    };
+    std::uint64_t total = 0, lost = 0;
+    for (std::uint32_t n = 0; n < rings; ++n) {
+        std::string path = prefix + "." + std::to_string(n);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        struct stat st;
+        void* p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && std::size_t(st.st_size) >= sizeof(TraceFileHeader))
+            p = mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { std::cerr << "Cannot map " << path << "\n"; continue; }
+        auto* hdr = static_cast<const TraceFileHeader*>(p);
+        std::uint64_t cap = hdr->capacity, head = hdr->head.load();
+        if (std::memcmp(hdr->magic, TRACE_MAGIC, 8) != 0 || hdr->version != TRACE_VERSION
+            || sizeof(TraceFileHeader) + cap * sizeof(TraceEvent) > std::size_t(st.st_size)) {
+            std::cerr << path << ": not a trace ring\n";
+            munmap(p, std::size_t(st.st_size));
+            continue;
+        }
+        auto* ev = reinterpret_cast<const TraceEvent*>(hdr + 1);
+        std::uint64_t from = head > cap ? head - cap : 0;
+        lost += from;
+        begin("M", n, 0);
+        out << ",\"name\":\"thread_name\",\"args\":{\"name\":\"vm-" << n << "\"}}";
+        std::vector<std::uint32_t> open;    // functions entered in the kept window
+        double last = 0;
+        for (std::uint64_t k = from; k < head; ++k) {
+            const TraceEvent& e = ev[k & (cap - 1)];
+            double us = usOf(e.ts);
+            last = us;
+            switch (e.type()) {
+            case TraceType::Enter:
+                begin("B", n, us);
+                out << ",\"name\":";
+                jsonString(out, nameOf(e.fn));
+                out << "}";
+                open.push_back(e.fn);
+                break;
+            case TraceType::Exit:
+                if (open.empty()) break;    // entered before the ring wrapped
+                begin("E", n, us);
+                out << "}";
+                open.pop_back();
+                break;
+            case TraceType::Branch:
+                if (!branches) break;
+                begin("i", n, us);
+                out << ",\"s\":\"t\",\"name\":\"branch\",\"args\":{\"fn\":";
+                jsonString(out, nameOf(e.fn));
+                out << ",\"to\":" << e.pc() << "}}";
+                break;
+            case TraceType::Say:
+            case TraceType::Timer:
+                begin("i", n, us);
+                out << ",\"s\":\"t\",\"name\":\"" << traceName(e.type()) << "\",\"args\":{\"fn\":";
+                jsonString(out, nameOf(e.fn));
+                out << ",\"pc\":" << e.pc() << "}}";
+                break;
+            }
+            ++total;
+        }
+        for (; !open.empty(); open.pop_back()) { begin("E", n, last); out << "}"; }
+        munmap(p, std::size_t(st.st_size));
+    }
+    out << "\n]}\n";
+    std::cerr << total << " events";
+    if (lost) std::cerr << " (" << lost << " older events overwritten)";
+    std::cerr << "\n";
+    return out ? 0 : 1;
+}
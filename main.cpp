@@ -4,35 +4,543 @@
 #include "EmitHEX.hpp"
 #include "EmitCIL.hpp"
 #include "Runner.cpp"  // VM and scheduler
+#include "PassStats.hpp"
+#include "Server.hpp"
+#include "Repl.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <cstdlib>
+#include <new>
+#include <climits>
+#include <charconv>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-int main(int argc, char** argv){
-    if (argc<2){ std::cerr<<"Usage: cmajor <file.cmaj> [--hex] [--cil] [--run]\n"; return 1; }
+// Counting allocator for --stats / --time-passes: off until main() turns it
+// on, so the default path only pays for one branch per allocation.
+static bool countHeap=false;
+#ifdef __GLIBC__
+// GCC inlines these and then flags the malloc/free pair as a new/delete mismatch
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(std::size_t n){
+    void* p=std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    if (countHeap) heapAlloc(malloc_usable_size(p));
+    return p;
+}
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    if (countHeap) heapFree(malloc_usable_size(p));
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+#pragma GCC diagnostic pop
+#endif
+
+static std::size_t astNodes(const ASTPtr& n){
+    std::size_t k=1;
+    for (auto& c : n->kids) if (c) k+=astNodes(c);
+    return k;
+}
+
+// mtime (ns) + size of a source; a change in either triggers a recompile
+static std::pair<long long,long long> stamp(const char* path){
+    struct stat st; if (stat(path,&st)!=0) return {0,0};
+    return {static_cast<long long>(st.st_mtim.tv_sec)*1000000000LL+st.st_mtim.tv_nsec, static_cast<long long>(st.st_size)};
+}
+
+// inputs: every argument that is not a flag or -o's value; @list adds one path per line
+static bool collectInputs(const std::vector<std::string>& args, std::vector<std::string>& inputs, bool& batch){
+    batch=false;
+    for (std::size_t i=1;i<args.size();i++){
+        const std::string& a=args[i];
+        if (a=="-o"){ ++i; continue; }
+        if (a.empty() || a[0]=='-') continue;
+        if (a[0]!='@'){ inputs.push_back(a); continue; }
+        batch=true;
+        std::ifstream list(a.substr(1));
+        if (!list){ std::cerr<<"Cannot open "<<a.substr(1)<<"\n"; return false; }
+        for (std::string line; std::getline(list,line);){
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r")+1);
+            if (!line.empty()) inputs.push_back(line);
+        }
+    }
+    batch = batch || inputs.size()>1;
+    return true;
+}
+
+static bool isCapsule(const std::string& path){
+    static const std::string ext=".cmajcapsule";
+    return path.size()>ext.size() && path.compare(path.size()-ext.size(), ext.size(), ext)==0;
+}
+
+// -----------------------------
+// Compile server:
+// -----------------------------
+// `cmajor --server` keeps every module it has compiled, and for single-file
+// requests the decoded, superop-fused VM too, keyed by absolute path and
+// the flags that change either. Requests run in a fork of the server (see
+// Server.hpp), so each starts from warm copies; a changed mtime or size
+// recompiles the entry before the fork.
+struct WarmModule {
+    std::pair<long long,long long> stamp;
+    IRModule mod;
+    std::unique_ptr<VM> vm;         // never run in the server itself
+};
+static std::unordered_map<std::string, WarmModule> warmCache;
+static const std::size_t WARM_LIMIT=4096;   // modules; past it the cache starts over
+
+static std::string warmFlags(const std::vector<std::string>& args){
+    std::string flags;
+    for (auto& a : args)
+        if (a=="--no-auto-par" || a=="--no-superops" || a.rfind("--superop-profile=",0)==0) flags+="\n"+a;
+    return flags;
+}
+
+static std::string warmKey(const std::string& path, const std::string& flags){
+    char cwd[PATH_MAX];
+    if (path.empty() || path[0]=='/' || !getcwd(cwd, sizeof cwd)) return path+flags;
+    return std::string(cwd)+"/"+path+flags;
+}
+
+// The cached module for path if it is still current (never outside --server).
+static WarmModule* findWarm(const std::string& path, const std::string& flags){
+    if (warmCache.empty()) return nullptr;
+    auto it=warmCache.find(warmKey(path, flags));
+    return it!=warmCache.end() && it->second.stamp==stamp(path.c_str()) ? &it->second : nullptr;
+}
+
+// Server side of a request: compile whatever is missing or stale. Errors
+// are left for the request itself to report.
+static void warmUp(const std::vector<std::string>& args){
+    std::vector<std::string> inputs; bool batch;
+    if (!collectInputs(args, inputs, batch)) return;
+    const std::string flags=warmFlags(args);
+    SuperopTable superops=SuperopTable::defaults();
+    bool autoPar=true;
+    for (auto& a : args){
+        if (a=="--no-auto-par") autoPar=false;
+        if (a=="--no-superops") superops.enabled=false;
+        if (a.rfind("--superop-profile=",0)==0) superops.loadProfile(a.substr(18));
+    }
+    for (auto& path : inputs){
+        if (isCapsule(path) || findWarm(path, flags)) continue;
+        std::ifstream in(path); if (!in) continue;
+        std::stringstream buf; buf<<in.rdbuf();
+        if (warmCache.size()>=WARM_LIMIT) warmCache.clear();
+        WarmModule& w=warmCache[warmKey(path, flags)];
+        w.vm.reset();           // points into w.mod
+        try {
+            w.stamp=stamp(path.c_str());
+            Lexer lx(buf.str()); auto toks=lx.tokenize();
+            Parser ps(toks); auto ast=ps.parseProgram();
+            IRGen gen; gen.autoParallel=autoPar;
+            w.mod=gen.generate(ast);
+            if (!batch) w.vm=std::make_unique<VM>(w.mod, superops);
+        } catch (const std::exception&){
+            warmCache.erase(warmKey(path, flags));
+        }
+    }
+}
 
-    std::ifstream in(argv[1]); if(!in){ std::cerr<<"Cannot open "<<argv[1]<<"\n"; return 1; }
-    std::stringstream buf; buf<<in.rdbuf();
+// -----------------------------
+// Batch compilation:
+// -----------------------------
+// `cmajor a.cmaj b.cmaj @more.txt --hex -o out/` compiles every input on a
+// pool of --jobs threads. Each file gets its own lexer, parser and IRGen;
+// the superop table and the options are built once and only read. Outputs
+// go to out/<stem>.hex, .cil and .cmajcapsule (next to the source without
+// -o). Programs are not run.
+struct BatchOptions {
+    bool hex=false, hexBinary=false, cil=false, capsule=false, autoPar=true;
+    std::string outDir;
+    std::string warmFlags;          // --server cache key, see warmKey
+    const SuperopTable* superops=nullptr;
+};
 
-    Lexer lx(buf.str()); auto toks = lx.tokenize();
-    Parser ps(toks); auto ast = ps.parseProgram();
+// Diagnostics for one file; printed together, in input order.
+struct BatchResult {
+    std::string diag;
+    bool ok=true, done=false;
+};
 
-    IRGen gen; auto mod = gen.generate(ast);
+static std::string batchOutput(const std::string& src, const BatchOptions& o, const char* ext){
+    std::string stem=src.substr(0, src.rfind('.'));
+    if (!o.outDir.empty()){
+        std::size_t slash=stem.rfind('/');
+        if (slash!=std::string::npos) stem=stem.substr(slash+1);
+        stem=o.outDir+"/"+stem;
+    }
+    return stem+ext;
+}
 
-    bool doHex=false, doCil=false, doRun=true;
-    for (int i=2;i<argc;i++){
+static void compileOne(const std::string& path, const BatchOptions& o, BatchResult& r){
+    auto fail=[&](const std::string& msg){ r.diag+=path+": "+msg+"\n"; r.ok=false; };
+    if (isCapsule(path)){ fail("already compiled"); return; }
+    IRModule fresh;
+    const IRModule* warm=nullptr;
+    if (WarmModule* w=findWarm(path, o.warmFlags)) warm=&w->mod;
+    else {
+        std::ifstream in(path); if (!in){ fail("cannot open"); return; }
+        std::stringstream buf; buf<<in.rdbuf();
+        try {
+            Lexer lx(buf.str()); auto toks=lx.tokenize();
+            Parser ps(toks); auto ast=ps.parseProgram();
+            IRGen gen; gen.autoParallel=o.autoPar;
+            fresh=gen.generate(ast);
+        } catch (const std::exception& e){ fail(e.what()); return; }
+    }
+    const IRModule& mod=warm ? *warm : fresh;
+    // one thread per file: the pool already keeps every core busy
+    auto emit=[&](const char* ext, auto fn){
+        std::string out=batchOutput(path, o, ext);
+        std::unique_ptr<EmitSink> sink(FdSink::open(out));
+        if (!sink){ fail("cannot open "+out); return; }
+        fn(*sink);
+        sink->flush();
+        if (!sink->ok()) fail("write failed: "+out);
+    };
+    if (o.hex) emit(".hex", [&](EmitSink& s){ emitHEX(mod, s, o.hexBinary ? HexMode::Binary : HexMode::Text, 1); if (!o.hexBinary) s.write("\n"); });
+    if (o.cil) emit(".cil", [&](EmitSink& s){ emitCIL(mod, s, 1); s.write("\n"); });
+    if (o.capsule){
+        std::string out=batchOutput(path, o, ".cmajcapsule");
+        VM vm(mod, *o.superops);
+        if (!vm.saveCapsule(out)) fail("cannot write capsule "+out);
+    }
+}
+
+static int compileBatch(std::vector<std::string> inputs, const BatchOptions& o, std::size_t jobs){
+    {   // a file listed twice would be written by two threads at once
+        std::unordered_set<std::string> seen;
+        inputs.erase(std::remove_if(inputs.begin(), inputs.end(), [&](const std::string& in){ return !seen.insert(in).second; }), inputs.end());
+    }
+    if (!o.outDir.empty()){
+        struct stat st;
+        if (stat(o.outDir.c_str(), &st)!=0 && mkdir(o.outDir.c_str(), 0755)!=0){ std::cerr<<"Cannot create "<<o.outDir<<"\n"; return 1; }
+        if (stat(o.outDir.c_str(), &st)!=0 || !S_ISDIR(st.st_mode)){ std::cerr<<"-o "<<o.outDir<<" must be a directory when compiling several files\n"; return 1; }
+        // out/<stem>.* would be written twice
+        std::unordered_map<std::string,std::string> seen;
+        for (auto& in : inputs){
+            auto prev=seen.emplace(batchOutput(in, o, ""), in);
+            if (!prev.second){
+                std::cerr<<in<<" and "<<prev.first->second<<" would both write "<<prev.first->first<<".*\n";
+                return 1;
+            }
+        }
+    }
+    std::vector<BatchResult> results(inputs.size());
+    std::mutex printMtx; std::size_t printed=0;
+    auto compile=[&](std::size_t k){
+        BatchResult r;
+        compileOne(inputs[k], o, r);
+        // flush every finished file in front of the first one still compiling
+        std::lock_guard<std::mutex> lock(printMtx);
+        results[k]=std::move(r);
+        results[k].done=true;
+        for (; printed<results.size() && results[printed].done; ++printed){
+            std::cerr<<results[printed].diag;
+            results[printed].diag.clear();
+        }
+    };
+    if (jobs>1){
+        WorkStealingPool pool(jobs-1);   // the calling thread works too
+        pool.parallelFor(inputs.size(), compile);
+    } else for (std::size_t k=0;k<inputs.size();k++) compile(k);
+    std::size_t failed=0;
+    for (auto& r : results) if (!r.ok) ++failed;
+    if (failed) std::cerr<<failed<<" of "<<inputs.size()<<" file(s) failed\n";
+    return failed ? 1 : 0;
+}
+
+// Reads N from `--name=N` into out. False, after saying so, when a is that
+// flag but N is not a whole number that fits out; true for any other flag.
+template<class T>
+static bool numFlag(const std::string& a, const std::string& prefix, T& out){
+    if (a.compare(0, prefix.size(), prefix)!=0) return true;
+    const char* first=a.data()+prefix.size();
+    const char* last=a.data()+a.size();
+    T v{};
+    auto r=std::from_chars(first, last, v);
+    if (first==last || r.ec!=std::errc() || r.ptr!=last){
+        std::cerr<<"Bad value in "<<a<<": expected a whole number\n";
+        return false;
+    }
+    out=v;
+    return true;
+}
+
+static int cmajorMain(int argc, char** argv){
+    const char* usage=
+        "Usage: cmajor <file.cmaj|file.cmajcapsule> [more.cmaj|@list ...] [--jobs=N] [--repl] [--server[=SOCKET]] [--client[=SOCKET]]\n"
+        "         [--hex|--hex-binary] [--cil] [-o out] [--run|--no-run] [--watch] [--emit-capsule[=out]]\n"
+        "         [--no-superops] [--superop-profile=PATH] [--dump-superops] [--max-depth=N]\n"
+        "         [--workers=N] [--instances=N] [--budget=N] [--par-workers=N] [--par-min-trip=N] [--no-auto-par]\n"
+        "         [--timer-workers=N] [--run-for=MS] [--timer-stats=PATH] [--timer-stats-interval=MS] [--timer-log=PATH]\n"
+        "         [--flush=line|size|interval|exit] [--flush-size=BYTES] [--flush-interval=MS] [--unbuffered]\n"
+        "         [--time-passes] [--stats] [--stats-json=PATH]\n"
+        "         [--profile[=out.folded]] [--profile-interval=US] [--profile-exact] [--profile-top=N]\n"
+        "         [--trace[=PREFIX]] [--trace-events=N] [--simd=auto|avx|sse|scalar]\n";
+    const std::vector<std::string> args(argv, argv+argc);
+    std::vector<std::string> inputs;
+    bool batch=false;
+    if (!collectInputs(args, inputs, batch)) return 1;
+    const bool repl=std::find(args.begin(), args.end(), "--repl")!=args.end();
+    if (inputs.empty() && !repl){ std::cerr<<usage; return 1; }
+    const std::string flags=warmFlags(args);
+
+    std::string path=inputs.empty() ? "" : inputs[0];
+    const std::string capsuleExt=".cmajcapsule";
+    bool fromCapsule = isCapsule(path);
+    std::string emitCapsule, outPath;
+    bool hexBinary=false;
+
+    bool doHex=false, doCil=false, doRun=true, runAsked=false, dumpSuperops=false;
+    std::size_t jobs=std::thread::hardware_concurrency();
+    std::size_t maxDepth=100000, workers=0, instances=1;
+    std::uint32_t budget=1000;
+    std::size_t parWorkers=std::thread::hardware_concurrency();
+    long long parMinTrip=1024;
+    bool autoPar=true, watch=false;
+    std::size_t timerWorkers=0;
+    long long runFor=-1;    // how long schedule/every timers may keep running (-1 = until none are left)
+    std::string timerStats; long long timerStatsMs=1000;
+    std::string timerLog;   // mutation log for cmajor_timeline, written when the timers stop
+    bool timePasses=false, showStats=false; std::string statsJson;
+    std::string profileOut; int profileUs=1000; bool profileExact=false; std::size_t profileTop=20;
+    std::string tracePrefix; std::uint64_t traceEvents=1<<20;   // events kept per thread
+    // line-buffer a terminal, batch everything else
+    FlushPolicy flushPolicy = isatty(STDOUT_FILENO) ? FlushPolicy::Line : FlushPolicy::Size;
+    std::size_t flushSize=64*1024; int flushMs=50; bool unbuffered=false;
+    SuperopTable superops = SuperopTable::defaults();
+    for (int i=1;i<argc;i++){
         std::string a=argv[i];
         if (a=="--hex") doHex=true;
         if (a=="--cil") doCil=true;
+        if (a=="--hex-binary"){ doHex=true; hexBinary=true; }
+        if (a=="-o" && i+1<argc) outPath=argv[++i];
         if (a=="--no-run") doRun=false;
-        if (a=="--run") doRun=true;
+        if (a=="--run"){ doRun=true; runAsked=true; }
+        if (a=="--dump-superops") dumpSuperops=true;
+        if (a=="--no-superops") superops.enabled=false;
+        if (a.rfind("--superop-profile=",0)==0 && !superops.loadProfile(a.substr(18)))
+            std::cerr<<"Cannot open superop profile "<<a.substr(18)<<"\n";
+        if (a=="--no-auto-par") autoPar=false;
+        if (a=="--watch") watch=true;
+        if (a.rfind("--timer-stats=",0)==0) timerStats=a.substr(14);
+        if (a.rfind("--timer-log=",0)==0) timerLog=a.substr(12);
+        if (a=="--time-passes") timePasses=true;
+        if (a=="--stats") showStats=true;
+        if (a.rfind("--stats-json=",0)==0) statsJson=a.substr(13);
+        if (a=="--profile") profileOut=path.substr(0,path.rfind('.'))+".folded";
+        if (a.rfind("--profile=",0)==0) profileOut=a.substr(10);
+        if (a=="--profile-exact") profileExact=true;
+        if (a=="--trace") tracePrefix=path.substr(0,path.rfind('.'))+".trace";
+        if (a.rfind("--trace=",0)==0) tracePrefix=a.substr(8);
+        if (a=="--emit-capsule") emitCapsule=path.substr(0,path.rfind('.'))+capsuleExt;
+        if (a.rfind("--emit-capsule=",0)==0) emitCapsule=a.substr(15);
+        if (a=="--unbuffered") unbuffered=true;
+        if (a=="--flush=line") flushPolicy=FlushPolicy::Line;
+        if (a=="--flush=size") flushPolicy=FlushPolicy::Size;
+        if (a=="--flush=interval") flushPolicy=FlushPolicy::Interval;
+        if (a=="--flush=exit") flushPolicy=FlushPolicy::Exit;
+        if (!numFlag(a, "--jobs=", jobs) || !numFlag(a, "--max-depth=", maxDepth) || !numFlag(a, "--workers=", workers)
+            || !numFlag(a, "--instances=", instances) || !numFlag(a, "--budget=", budget)
+            || !numFlag(a, "--par-workers=", parWorkers) || !numFlag(a, "--par-min-trip=", parMinTrip)
+            || !numFlag(a, "--timer-workers=", timerWorkers) || !numFlag(a, "--run-for=", runFor)
+            || !numFlag(a, "--timer-stats-interval=", timerStatsMs) || !numFlag(a, "--profile-interval=", profileUs)
+            || !numFlag(a, "--profile-top=", profileTop) || !numFlag(a, "--trace-events=", traceEvents)
+            || !numFlag(a, "--flush-size=", flushSize) || !numFlag(a, "--flush-interval=", flushMs)){
+            std::cerr<<usage;
+            return 1;
+        }
+        if (a.rfind("--simd=",0)==0 && !selectVecKernels(a.substr(7))){
+            std::cerr<<"SIMD kernels '"<<a.substr(7)<<"' are not available on this CPU\n";
+            return 1;
+        }
+    }
+
+    if (repl){
+        // an optional source file only preloads its definitions; main is not run
+        if (batch || fromCapsule){ std::cerr<<"--repl takes at most one source file\n"; return 1; }
+        OutputSink::instance().configure(flushPolicy, flushSize, flushMs, unbuffered);
+        IRModule none;
+        VM vm(none, superops);
+        vm.setMaxDepth(maxDepth);
+        vm.setParallel(parWorkers, parMinTrip);
+        vm.setTimerWorkers(timerWorkers);
+        vm.setTimerLog(timerLog);
+        Repl session(vm, autoPar);
+        if (!path.empty()){
+            std::ifstream in(path); if (!in){ std::cerr<<"Cannot open "<<path<<"\n"; return 1; }
+            std::stringstream buf; buf<<in.rdbuf();
+            if (!session.eval(buf.str())) return 1;
+        }
+        int status=session.run(std::cin, std::cout, isatty(STDIN_FILENO));
+        if (!vm.stopTimers()){ std::cerr<<"Cannot write "<<timerLog<<"\n"; status=1; }
+        return status;
+    }
+
+    if (batch){
+        if (runAsked || watch){ std::cerr<<"--run and --watch take a single input\n"; return 1; }
+        BatchOptions o;
+        o.hex=doHex; o.hexBinary=hexBinary; o.cil=doCil; o.capsule=!emitCapsule.empty();
+        o.autoPar=autoPar; o.outDir=outPath; o.warmFlags=flags; o.superops=&superops;
+        return compileBatch(inputs, o, jobs);
     }
-    if (doHex) std::cout << emitHEX(mod) << "\n";
-    if (doCil) std::cout << emitCIL(mod) << "\n";
 
-    if (doRun){
-        VM vm(mod);
-        vm.call("main"); // run capsule/func named main
+    PassStats passStats;
+    PassStats* pstats = (timePasses || showStats || !statsJson.empty()) ? &passStats : nullptr;
+    countHeap = pstats!=nullptr;
+
+    // a capsule is already compiled: map it and skip lex/parse/IRGen
+    IRModule mod; std::shared_ptr<Capsule> capsule;
+    WarmModule* warm = fromCapsule ? nullptr : findWarm(path, flags);
+    if (fromCapsule){
+        PassStats::Scope pass(pstats, "open capsule");
+        std::string err; capsule=Capsule::open(path, err);
+        if (!capsule){ std::cerr<<path<<": "<<err<<"\n"; return 1; }
+        if (doHex || doCil || watch){ std::cerr<<"--hex, --cil and --watch need a source file\n"; return 1; }
+    } else if (!warm){
+        std::ifstream in(path); if(!in){ std::cerr<<"Cannot open "<<path<<"\n"; return 1; }
+        std::stringstream buf; buf<<in.rdbuf();
+
+        std::vector<Token> toks; ASTPtr ast;
+        { PassStats::Scope pass(pstats, "lex"); Lexer lx(buf.str()); toks = lx.tokenize(); }
+        { PassStats::Scope pass(pstats, "parse"); Parser ps(toks); ast = ps.parseProgram(); }
+
+        IRGen gen; gen.autoParallel=autoPar; gen.stats=pstats;
+        { PassStats::Scope pass(pstats, "irgen"); mod = gen.generate(ast); }
+        if (pstats){
+            std::size_t instrs=0;
+            for (auto& f : mod.funcs){ pstats->funcSizes.emplace_back(f.name, f.code.size()); instrs+=f.code.size(); }
+            pstats->count("tokens", toks.size());
+            pstats->count("ast_nodes", astNodes(ast));
+            pstats->count("ir_functions", mod.funcs.size());
+            pstats->count("ir_instructions", instrs);
+        }
+    }
+    const IRModule& code = warm ? warm->mod : mod;
+    if (!fromCapsule){
+        if (doHex || doCil){
+            PassStats::Scope pass(pstats, "emit");
+            // formatted per function in parallel, streamed straight to stdout or -o
+            std::unique_ptr<EmitSink> out(outPath.empty() ? new FdSink(STDOUT_FILENO) : FdSink::open(outPath));
+            if (!out){ std::cerr<<"Cannot open "<<outPath<<"\n"; return 1; }
+            if (doHex){ emitHEX(code, *out, hexBinary ? HexMode::Binary : HexMode::Text); if (!hexBinary) out->write("\n"); }
+            if (doCil){ emitCIL(code, *out); out->write("\n"); }
+            out->flush();
+            if (!out->ok()){ std::cerr<<"Write failed: "<<(outPath.empty() ? "stdout" : outPath)<<"\n"; return 1; }
+        }
+    }
+
+    OutputSink::instance().configure(flushPolicy, flushSize, flushMs, unbuffered);
+    int status=0;   // 1 once main fails at run time
+    if (doRun || dumpSuperops || !emitCapsule.empty()){
+        std::unique_ptr<VM> vmp;
+        if (!warm || !warm->vm){   // decode and superop fusion
+            PassStats::Scope pass(pstats, "load");
+            vmp = capsule ? std::make_unique<VM>(capsule, superops) : std::make_unique<VM>(code, superops);
+        }
+        VM& vm = vmp ? *vmp : *warm->vm;
+        PassStats::Scope runPass(doRun ? pstats : nullptr, "run");
+        if (!emitCapsule.empty() && !vm.saveCapsule(emitCapsule)){
+            std::cerr<<"Cannot write capsule "<<emitCapsule<<"\n"; return 1;
+        }
+        vm.setMaxDepth(maxDepth);
+        vm.setParallel(parWorkers, parMinTrip);
+        vm.setTimerWorkers(timerWorkers);
+        if (doRun && !profileOut.empty()) vm.startProfile(profileUs, profileExact);
+        if (doRun && !tracePrefix.empty()) vm.startTrace(tracePrefix, traceEvents);
+        if (!timerStats.empty()) vm.setTimerStats(timerStats, timerStatsMs);
+        vm.setTimerLog(timerLog);
+        if (dumpSuperops) vm.dumpSuperops(std::cout);
+        if (doRun && watch){
+            // keep main running as fibers; recompile and hot-swap on every save
+            FiberPool pool(vm, workers ? workers : 1, budget);
+            for (std::size_t k=0;k<instances;k++) if (!pool.spawn("main")) status=1;
+            auto seen = stamp(path.c_str());
+            while (!pool.waitFor(200)){
+                auto now = stamp(path.c_str());
+                if (now==seen) continue;
+                seen=now;
+                try {
+                    std::ifstream src(path); std::stringstream text; text<<src.rdbuf();
+                    Lexer l2(text.str()); auto t2 = l2.tokenize();
+                    Parser p2(t2); auto a2 = p2.parseProgram();
+                    IRGen g2; g2.autoParallel=autoPar;
+                    std::cerr<<"hot-swapped "<<vm.swap(g2.generate(a2))<<" function(s)\n";
+                } catch (const std::exception& e){
+                    std::cerr<<"watch: "<<path<<": "<<e.what()<<" (keeping old code)\n";
+                }
+            }
+            if (pool.failed()) status=1;
+        } else if (doRun && (workers || instances>1)){
+            // run `instances` copies of main as fibers over `workers` threads
+            FiberPool pool(vm, workers ? workers : std::thread::hardware_concurrency(), budget);
+            for (std::size_t k=0;k<instances;k++) if (!pool.spawn("main")) status=1;
+            pool.wait();
+            if (pool.failed()) status=1;
+        } else if (doRun && !vm.call("main")) status=1; // run capsule/func named main
+        // capsules registered with schedule/every keep the process alive
+        if (doRun){
+            vm.waitTimers(runFor);
+            if (!vm.stopTimers()){ std::cerr<<"Cannot write "<<timerLog<<"\n"; status=1; }
+        }
+        if (doRun && !profileOut.empty()){
+            std::ofstream folded(profileOut);
+            vm.writeProfile(folded, std::cerr, profileTop);
+            if (!folded) std::cerr<<"Cannot write "<<profileOut<<"\n";
+        }
+        if (doRun && !tracePrefix.empty() && !vm.stopTrace())
+            std::cerr<<"Cannot write trace "<<tracePrefix<<".*\n";
+    }
+    OutputSink::instance().flush();
+    if (pstats){
+        if (timePasses) passStats.printPasses(std::cerr);
+        if (showStats) passStats.printStats(std::cerr);
+        if (statsJson=="-") passStats.printJSON(std::cerr);
+        else if (!statsJson.empty()){
+            std::ofstream out(statsJson);
+            passStats.printJSON(out);
+            if (!out){ std::cerr<<"Cannot write "<<statsJson<<"\n"; return 1; }
+        }
+    }
+    return status;
+}
+
+// Run the request (argv[0] included) and push its output out before the
+// server's child exits.
+static int handleRequest(const std::vector<std::string>& args){
+    std::vector<std::string> copy(args);
+    std::vector<char*> av;
+    for (auto& a : copy) av.push_back(&a[0]);
+    av.push_back(nullptr);
+    int status=cmajorMain(static_cast<int>(copy.size()), av.data());
+    OutputSink::instance().flush();
+    std::cout.flush();
+    std::cerr.flush();
+    return status;
+}
+
+int main(int argc, char** argv){
+    std::vector<std::string> args(argv, argv+argc);
+    for (std::size_t i=1;i<args.size();i++){
+        const std::string& a=args[i];
+        if (a=="--server" || a.rfind("--server=",0)==0)
+            return serve(a.size()>9 ? a.substr(9) : defaultServerSocket(), warmUp, handleRequest);
+        if (a=="--client" || a.rfind("--client=",0)==0){
+            std::string sock=a.size()>9 ? a.substr(9) : defaultServerSocket();
+            args.erase(args.begin()+static_cast<std::ptrdiff_t>(i));
+            int status=0;
+            if (forward(sock, args, status)) return status;
+            break;  // no server running: compile in this process
+        }
     }
-    return 0;
+    return cmajorMain(argc, argv);
 }